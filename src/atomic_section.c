@@ -0,0 +1,89 @@
+/*
+** atomic_section.c
+**
+** Interrupts-off time tracing - see atomic_section.h.
+*/
+
+#include "atomic_section.h"
+
+#ifdef ATOMIC_TRACE
+
+#ifdef SFX_DDS
+#error "ATOMIC_TRACE and SFX_DDS can't be used together - both need timer 1"
+#endif
+
+static uint16_t maxCycles[NUM_ATOMIC_SITES];
+static uint32_t totalCycles[NUM_ATOMIC_SITES];
+static uint32_t counts[NUM_ATOMIC_SITES];
+
+#ifdef ATOMIC_LIMIT
+volatile uint8_t atomicLimitSite;
+volatile uint16_t atomicLimitCycles;
+#endif
+
+/* See comment in .h file */
+void init_atomic_trace(void)
+{
+	uint8_t i;
+
+	/* Timer 1 runs freely at the CPU clock rate (profile.c and
+	** sampler.c set it up the same way).
+	*/
+	TCCR1A = 0;
+	TCCR1B = (1<<CS10);
+
+	for(i=0; i < NUM_ATOMIC_SITES; i++) {
+		maxCycles[i] = 0;
+		totalCycles[i] = 0;
+		counts[i] = 0;
+	}
+}
+
+/* See comment in .h file */
+uint8_t atomic_get_stats(uint8_t site, uint16_t* max, uint32_t* total,
+		uint32_t* count)
+{
+	if(site >= NUM_ATOMIC_SITES) {
+		return 0;
+	}
+	/* (Not an ATOMIC_SECTION() - see atomic_section.h) */
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	cli();
+	*max = maxCycles[site];
+	*total = totalCycles[site];
+	*count = counts[site];
+	if(interruptsOn) {
+		sei();
+	}
+	return 1;
+}
+
+/* End of a section. Record the time interrupts were off (if they
+** were on at the start) and put them back the way they were.
+*/
+void atomic_section_exit(AtomicSection* section)
+{
+	uint16_t cycles = TCNT1 - section->start;
+	uint8_t site = section->site;
+
+	if(section->sreg & (1<<SREG_I)) {
+		if(cycles > maxCycles[site]) {
+			maxCycles[site] = cycles;
+		}
+		totalCycles[site] += cycles;
+		counts[site]++;
+#ifdef ATOMIC_LIMIT
+		if(cycles > ATOMIC_LIMIT) {
+			/* Stop here with interrupts off */
+			atomicLimitSite = site;
+			atomicLimitCycles = cycles;
+			while(1) {
+			}
+		}
+#endif
+	}
+	SREG = section->sreg;
+	__asm__ volatile ("" ::: "memory");
+}
+
+#endif
@@ -0,0 +1,129 @@
+/*
+** atomic_section.h
+**
+** Sections of code that run with interrupts turned off. Use as
+**
+**		ATOMIC_SECTION(ATOMIC_SPI_SUBMIT) {
+**			... code that must not be interrupted ...
+**		}
+**
+** Interrupts are turned off at the start of the block and, at the
+** end, put back to how they were (so sections may be nested, or used
+** in code that is called from interrupt handlers). Leaving the block
+** early with return or break is allowed.
+**
+** Every section has a site ID (below). If ATOMIC_TRACE is defined,
+** the longest time and the total time (in CPU cycles) that each site
+** has kept interrupts off are recorded - our worst case interrupt
+** latency can be no better than the longest of these. Sections
+** entered with interrupts already off are not counted. Tracing uses
+** timer 1 as a cycle counter, so can't be used with the DDS
+** synthesiser.
+**
+** If ATOMIC_LIMIT is defined (as a number of cycles), tracing is
+** turned on and a section that keeps interrupts off for longer than
+** this stops the program (like a failed assert()) - the site and
+** time are left in atomicLimitSite and atomicLimitCycles for a
+** debugger to look at.
+**
+** Two pieces of the measuring code turn interrupts off by hand
+** instead: atomic_get_stats() (a section there would update the
+** statistics it is reading) and the profile probes, profile_now()
+** and profile_record() (a section would add its own timer reads to
+** every probe - see profile.c).
+*/
+
+#ifndef ATOMIC_SECTION_H
+#define ATOMIC_SECTION_H
+
+#include <stdint.h>
+#include "hal.h"
+
+#if defined(ATOMIC_LIMIT) && !defined(ATOMIC_TRACE)
+#define ATOMIC_TRACE
+#endif
+
+/* Site IDs */
+enum {
+	ATOMIC_SPI_SUBMIT,
+	ATOMIC_COPY_FIELD,
+	ATOMIC_SCROLL_DISPLAY,
+	ATOMIC_PLAY_TONE,
+	ATOMIC_DDS_VOICE,
+	ATOMIC_DDS_STATS,
+	ATOMIC_PERSIST_SAVE,
+	ATOMIC_UART_SEND,
+	ATOMIC_UART_RECEIVE,
+	ATOMIC_JOYSTICK_OVERRIDE,
+	ATOMIC_INPUT_LATENCY,
+	ATOMIC_PROFILE_STATS,
+	ATOMIC_SAMPLER_STATS,
+	ATOMIC_LATENCY_STATS,
+	NUM_ATOMIC_SITES
+};
+
+#ifdef ATOMIC_TRACE
+
+typedef struct {
+	uint8_t sreg;
+	uint8_t site;
+	uint16_t start;
+} AtomicSection;
+
+/* init_atomic_trace()
+** - starts timer 1 counting CPU cycles and clears the statistics.
+*/
+void init_atomic_trace(void);
+
+/* atomic_get_stats()
+** - get the longest and total time (in cycles) that the given site
+** has kept interrupts off, and the number of times it has done so.
+** Returns 0 if the site is not valid, 1 otherwise.
+*/
+uint8_t atomic_get_stats(uint8_t site, uint16_t* maxCycles,
+		uint32_t* totalCycles, uint32_t* count);
+
+/* Used by ATOMIC_SECTION() */
+static inline AtomicSection atomic_section_enter(uint8_t site)
+{
+	AtomicSection section;
+
+	section.sreg = SREG;
+	cli();
+	section.site = site;
+	section.start = TCNT1;
+	return section;
+}
+void atomic_section_exit(AtomicSection* section);
+
+#define ATOMIC_SECTION(site) \
+	for(AtomicSection atomicSection_ \
+			__attribute__((cleanup(atomic_section_exit))) = \
+			atomic_section_enter(site), *atomicOnce_ = &atomicSection_; \
+		atomicOnce_; atomicOnce_ = 0)
+
+#else
+
+#define init_atomic_trace()
+
+/* Used by ATOMIC_SECTION() */
+static inline uint8_t atomic_enter(void)
+{
+	uint8_t sreg = SREG;
+	cli();
+	return sreg;
+}
+static inline void atomic_exit(const uint8_t* sreg)
+{
+	SREG = *sreg;
+	__asm__ volatile ("" ::: "memory");
+}
+
+#define ATOMIC_SECTION(site) \
+	for(uint8_t atomicSreg_ __attribute__((cleanup(atomic_exit))) = \
+			atomic_enter(), atomicOnce_ = 1; \
+		atomicOnce_; atomicOnce_ = 0)
+
+#endif
+
+#endif
@@ -0,0 +1,266 @@
+/*
+** autopilot.c
+**
+** A player for soak tests and load generation - see autopilot.h.
+**
+** The threat map is worked out afresh each step from the game field:
+**
+**		threat[x]	the sum, over the asteroids in column x, of how
+**					close each is to the bottom (FIELD_HEIGHT - y).
+**					0 if a projectile is already on its way up to
+**					the lowest asteroid in the column.
+**		lowest[x]	row of the lowest asteroid in column x
+**					(FIELD_HEIGHT if none)
+**		danger[x]	number of asteroids that would hit the base if
+**					it was at x when they next fall (or that it
+**					would move into)
+**
+** The base occupies (x-1, 0) to (x+1, 0) and (x, 1) - see
+** handleBaseCollision() in game.c.
+*/
+
+#include "autopilot.h"
+#include "game.h"
+#include "joystick.h"
+
+#if defined(AUTOPILOT) || defined(HAL_HOST)
+
+/* Lowest row an asteroid can be shot at - a projectile is fired into
+** row 2 and hits what it moves into.
+*/
+#define LOWEST_TARGET_ROW 3
+
+#define NO_TARGET -1
+
+/* Joystick buttons held to fire (button 1 - see joystick.h) */
+#define FIRE_BUTTONS 0x02
+
+/* State of the random number generator (never 0), the column the base
+** is heading for and whether the fire button was held last step (it
+** has to be released between presses).
+*/
+static HAL_THREAD_LOCAL uint16_t randomState = 1;
+static HAL_THREAD_LOCAL int8_t target = NO_TARGET;
+static HAL_THREAD_LOCAL uint8_t firing;
+
+/* Private functions - only used within this module */
+static void make_threat_map(uint8_t* threat, uint8_t* lowest,
+		uint8_t* danger);
+static int8_t choose_target(uint8_t* threat, uint8_t* lowest,
+		uint8_t* danger);
+static int8_t choose_escape(uint8_t* danger);
+static uint8_t closer(int8_t column, int8_t best, uint8_t* ties);
+static uint16_t autopilot_random(void);
+
+/*
+** See comment in .h file
+*/
+void autopilot_reset(uint16_t seed)
+{
+	randomState = seed ? seed : 1;
+	target = NO_TARGET;
+	firing = 0;
+}
+
+/*
+** See comment in .h file
+*/
+void autopilot_choose(int8_t* x, uint8_t* buttons)
+{
+	uint8_t threat[FIELD_WIDTH];
+	uint8_t lowest[FIELD_WIDTH];
+	uint8_t danger[FIELD_WIDTH];
+	int8_t next;
+
+	make_threat_map(threat, lowest, danger);
+
+	if(danger[basePosition]) {
+		/* Something is about to land on the base - get out of
+		** the way first.
+		*/
+		target = choose_escape(danger);
+	} else if(target == NO_TARGET || danger[target] ||
+			!threat[target] || lowest[target] < LOWEST_TARGET_ROW) {
+		/* Keep going for the same column while it is still worth
+		** shooting at, so the base doesn't dither between columns.
+		*/
+		target = choose_target(threat, lowest, danger);
+	}
+
+	*x = 0;
+	*buttons = 0;
+	if(target != NO_TARGET && target != basePosition) {
+		/* Move one column towards the target, unless that would
+		** put the base somewhere worse than it is now (wait for
+		** the asteroids to pass instead).
+		*/
+		next = (target < basePosition) ? basePosition - 1 :
+				basePosition + 1;
+		if(danger[next] <= danger[basePosition]) {
+			*x = (target < basePosition) ? -2 : 2;
+		}
+	} else if(target != NO_TARGET && !firing &&
+			numProjectiles < MAX_PROJECTILES) {
+		*buttons = FIRE_BUTTONS;
+	}
+	firing = (*buttons != 0);
+}
+
+#ifdef AUTOPILOT
+
+/*
+** See comment in .h file
+*/
+void init_autopilot(void)
+{
+	autopilot_reset(get_game_seed());
+}
+
+/*
+** See comment in .h file
+*/
+void autopilot_step(void)
+{
+	int8_t x;
+	uint8_t buttons;
+
+	autopilot_choose(&x, &buttons);
+	joystick_override(x, 0, buttons);
+}
+
+#endif
+
+/****************** INTERNAL FUNCTIONS *********************/
+
+/* make_threat_map()
+**  - fills in the threat, lowest and danger arrays (FIELD_WIDTH
+**    entries each) from the game field - see the comment at the top.
+*/
+static void make_threat_map(uint8_t* threat, uint8_t* lowest,
+		uint8_t* danger)
+{
+	uint8_t i, x, y;
+	int8_t column;
+
+	for(x=0; x < FIELD_WIDTH; x++) {
+		threat[x] = 0;
+		lowest[x] = FIELD_HEIGHT;
+		danger[x] = 0;
+	}
+	for(i=0; i < numAsteroids; i++) {
+		x = asteroids[i] >> 4;
+		y = asteroids[i] & 0x0F;
+		threat[x] += FIELD_HEIGHT - y;
+		if(y < lowest[x]) {
+			lowest[x] = y;
+		}
+		/* Rows 0 and 1 reach the bottom row (the whole base) on the
+		** next fall; row 2 reaches row 1 (the middle of the base).
+		*/
+		for(column = x - 1; column <= x + 1; column++) {
+			if(column >= 0 && column < FIELD_WIDTH &&
+					(y <= 1 || (y == 2 && column == x))) {
+				danger[column]++;
+			}
+		}
+	}
+	for(i=0; i < numProjectiles; i++) {
+		x = projectiles[i] >> 4;
+		y = projectiles[i] & 0x0F;
+		if(y < lowest[x]) {
+			threat[x] = 0;
+		}
+	}
+}
+
+/* choose_target()
+**  - returns the safe column with the most threat that can be shot
+**    at (nearest the base if there is more than one), or NO_TARGET
+**    if there is none.
+*/
+static int8_t choose_target(uint8_t* threat, uint8_t* lowest,
+		uint8_t* danger)
+{
+	uint8_t ties = 0;
+	int8_t best = NO_TARGET;
+	int8_t x;
+
+	for(x=0; x < FIELD_WIDTH; x++) {
+		if(danger[x] || !threat[x] || lowest[x] < LOWEST_TARGET_ROW) {
+			continue;
+		}
+		if(best == NO_TARGET || threat[x] > threat[best]) {
+			best = x;
+			ties = 1;
+		} else if(threat[x] == threat[best] && closer(x, best, &ties)) {
+			best = x;
+		}
+	}
+	return best;
+}
+
+/* choose_escape()
+**  - returns the column with the least danger (nearest the base if
+**    there is more than one).
+*/
+static int8_t choose_escape(uint8_t* danger)
+{
+	uint8_t ties = 1;
+	int8_t best = basePosition;
+	int8_t x;
+
+	for(x=0; x < FIELD_WIDTH; x++) {
+		if(danger[x] < danger[best]) {
+			best = x;
+			ties = 1;
+		} else if(x != best && danger[x] == danger[best] &&
+				closer(x, best, &ties)) {
+			best = x;
+		}
+	}
+	return best;
+}
+
+/* closer()
+**  - tie break between two columns that are equally good: returns 1
+**    if "column" should replace "best" because it is nearer the base.
+**    Columns the same distance away are picked at random, each with
+**    the same chance ("ties" counts the columns tied so far).
+*/
+static uint8_t closer(int8_t column, int8_t best, uint8_t* ties)
+{
+	int8_t distance = column - basePosition;
+	int8_t bestDistance = best - basePosition;
+
+	if(distance < 0) {
+		distance = -distance;
+	}
+	if(bestDistance < 0) {
+		bestDistance = -bestDistance;
+	}
+	if(distance < bestDistance) {
+		*ties = 1;
+		return 1;
+	}
+	if(distance == bestDistance) {
+		(*ties)++;
+		return (autopilot_random() % *ties) == 0;
+	}
+	return 0;
+}
+
+/* 16 bit xorshift generator - as game_random() in game.c, but with
+** its own state so the autopilot doesn't change the game.
+*/
+static uint16_t autopilot_random(void)
+{
+	uint16_t x = randomState;
+
+	x ^= x << 7;
+	x ^= x >> 9;
+	x ^= x << 8;
+	randomState = x;
+	return x;
+}
+
+#endif
@@ -0,0 +1,81 @@
+/*
+** autopilot.h
+**
+** A player that needs no-one at the board: for soak tests that run
+** for hours, and as a steady load (a full field of asteroids, the
+** base moving and projectiles in flight) while timings are measured.
+**
+** Every logic step the autopilot looks at the game field (see game.h)
+** and works out a threat map: for each column, how many asteroids
+** are in it and how close they are to the bottom. It then
+** - moves the base out of the way if an asteroid is about to land on
+**   it (or won't move it under one)
+** - otherwise moves the base under the column with the most threat
+**   that isn't already being shot at, and fires at it
+** Ties are broken at random, from its own generator.
+**
+** Its moves are made through the joystick - it pushes the joystick
+** left or right and presses and releases button 1, just as a player
+** would - so the normal input path (joystickX, joystickButtons and
+** game_step()) is used. What it does depends only on the game field
+** and its seed, so a game seed (see set_game_seed()) always gives
+** the same game. On the board both generators are seeded together
+** when a game starts (new_game() in project.c seeds the game with
+** the generator's current state) and by CMD_SET_STATE.
+**
+** On the board it is only compiled in if AUTOPILOT is defined, e.g.
+**		make DEFS="-DAUTOPILOT"
+** It then plays every game (the real joystick, and CMD_JOYSTICK - see
+** command.h - are ignored). Otherwise the macros below compile to
+** nothing. autopilot_reset() and autopilot_choose() are always built
+** for the host, where host/simulate and host/montecarlo use them when
+** run with -a.
+*/
+
+#ifndef AUTOPILOT_H
+#define AUTOPILOT_H
+
+#include <stdint.h>
+
+#if defined(AUTOPILOT) || defined(HAL_HOST)
+
+/* autopilot_reset()
+** - starts a new game, seeding the autopilot's random number
+** generator with the given seed.
+*/
+void autopilot_reset(uint16_t seed);
+
+/* autopilot_choose()
+** - works out what to do in this logic step from the game field.
+** Sets x to the joystick position (-2, 0 or 2 - see joystickX in
+** joystick.h) and buttons to the joystick buttons to hold. Call once
+** before each game_step().
+*/
+void autopilot_choose(int8_t* x, uint8_t* buttons);
+
+#endif
+
+#ifdef AUTOPILOT
+
+/* init_autopilot()
+** - starts a new game, seeded with the game seed (see
+** get_game_seed()).
+*/
+void init_autopilot(void);
+
+/* autopilot_step()
+** - works out what to do (autopilot_choose()) and holds the joystick
+** there (joystick_override()). Called at the start of each logic
+** step.
+*/
+void autopilot_step(void);
+#define AUTOPILOT_STEP() autopilot_step()
+
+#else
+
+#define init_autopilot()
+#define AUTOPILOT_STEP()
+
+#endif
+
+#endif
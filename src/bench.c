@@ -0,0 +1,488 @@
+/*
+** bench.c
+**
+** Benchmark firmware, built and run under the simavr simulator by
+** "make bench" (see tools/bench_check.py). It can also be run on the
+** board - the results are sent over the serial port.
+**
+** Instead of playing the game, main() sets up fixed scenarios and
+** measures (in CPU cycles, using timer 1 as a cycle counter) how long
+** the game functions and interrupt handlers take in each:
+**
+**		empty		no asteroids or projectiles
+**		full		MAX_ASTEROIDS asteroids
+**		projectiles	MAX_PROJECTILES projectiles in flight (and a
+**					few asteroids in their way)
+**		scroll		scrolling a message (longest scroll_display())
+**		poll		a joystick update on the SPI bus
+**		tick		the clock tick, with a sound effect playing
+**		send		sending a frame over the serial port
+**		receive		receiving bytes until the buffer overflows
+**		save		saving to EEPROM (see persist.h)
+**
+** Interrupts are kept off while functions are measured, so nothing
+** else is counted. An interrupt handler is measured by waiting (with
+** interrupts off) until its interrupt is pending and then letting
+** just that interrupt run; its time includes the AVR's interrupt
+** response and the RETI. Handlers that run several times (e.g. for
+** each SPI byte) report the longest time. simavr can't be given
+** serial input, so the receive handler is called directly instead
+** (see bench_receive()).
+**
+** Built with SFX_DDS (and DDS_SAMPLE_RATE and DDS_VOICES - see dds.h)
+** it is the DDS image instead, which only measures the synthesiser's
+** sample interrupt, in scenario "dds_<rate>x<voices>". Timer 1 is the
+** synthesiser's there, so timer 3 (the tone generator's, which isn't
+** used with SFX_DDS) counts the cycles. "make bench" builds one DDS
+** image for each configuration dds.h allows.
+**
+** The results are sent as lines of text:
+**
+**		BENCH name cycles
+**
+** followed by "BENCH done", after which the CPU is put to sleep with
+** interrupts off (which ends the simulation).
+**
+** Not measured: the sampling profiler's TIMER1_COMPB_vect (see
+** sampler.c). It is only in SAMPLE_PROFILE builds, which are for
+** measuring, and most of it is written in assembler.
+*/
+
+#include "hal.h"
+#include "game.h"
+#include "score.h"
+#include "led_display.h"
+#include "scrolling_char_display.h"
+#include "sseg_display.h"
+#include "pmod.h"
+#include "sfx.h"
+#include "spi.h"
+#include "joystick.h"
+#include "timer2.h"
+#include "uart.h"
+#include "persist.h"
+#include "project.h"
+#ifdef SFX_DDS
+#include "dds.h"
+#endif
+
+/* Globals that are defined in project.c in the game firmware */
+uint16_t high_score = 0;
+uint8_t show_high_score = 0;
+uint8_t seven_seg_data[10] = {63,6,91,79,102,109,125,7,127,111};
+uint8_t seven_seg_cat = 0;
+uint16_t dropped_logic_steps = 0;
+
+/* Number of clock ticks over which the timer 2 handler is measured
+** (enough for every tick task to run at least once - see timer2.c)
+*/
+#define BENCH_TICKS 20
+
+/* Number of samples over which the DDS sample handler is measured */
+#define BENCH_SAMPLES 64
+
+/* The cycle counter (see the comment at the top) */
+#ifdef SFX_DDS
+#define CYCLE_COUNT TCNT3
+#else
+#define CYCLE_COUNT TCNT1
+#endif
+
+#define STRING(x) #x
+#define EXPANDED_STRING(x) STRING(x)
+
+/* CALL_VECTOR(vector)
+**  - runs an interrupt handler by calling it. Its RETI turns
+**    interrupts on, so they are turned off again straight away.
+*/
+#define CALL_VECTOR(vector) \
+	asm volatile("call " EXPANDED_STRING(vector) "\n\tcli" ::: "memory")
+
+/* Cycles taken by an empty measurement (subtracted from the others) */
+static uint16_t callOverhead;
+static uint16_t isrOverhead;
+
+/* CYCLES(result, code)
+**  - runs the code and sets result to the number of cycles it took.
+**    Interrupts must be off.
+*/
+#define CYCLES(result, code) do { \
+		uint16_t cyclesStart = CYCLE_COUNT; \
+		code; \
+		result = CYCLE_COUNT - cyclesStart - callOverhead; \
+	} while(0)
+
+/* Private functions - only used within this module */
+static uint16_t isr_cycles(void);
+#ifdef SFX_DDS
+static void bench_dds(void);
+#else
+static void set_field(uint8_t asteroidCount, uint8_t projectileCount);
+static void bench_field(const char* scenario, uint8_t asteroidCount,
+		uint8_t projectileCount);
+static void bench_scroll(void);
+static void bench_poll(void);
+static void bench_tick(void);
+static void bench_uart(void);
+static void bench_receive(void);
+static void bench_eeprom(void);
+#endif
+static void report(const char* name, const char* scenario,
+		uint16_t cycles);
+static void put_char(char c);
+static void put_string(const char* string);
+
+/* Called by game.c when the base has no health left - the scenarios
+** are set up again before each measurement, so nothing to do.
+*/
+void gameOver(void)
+{
+}
+
+int main(void)
+{
+	/* The cycle counter counts CPU cycles (normal mode, no
+	** prescaling)
+	*/
+#ifdef SFX_DDS
+	TCCR3A = 0;
+	TCCR3B = (1<<CS30);
+	init_uart();
+#else
+	TCCR1A = 0;
+	TCCR1B = (1<<CS10);
+
+	init_display();
+	init_spi();
+	init_joystick();
+	init_uart();
+	init_sseg_score_display();
+	init_pmod();
+	init_sfx();
+	init_score();
+	init_persist();
+#endif
+
+	/* Measure an empty measurement and an interrupt-less sei/cli */
+	callOverhead = 0;
+	CYCLES(callOverhead, );
+	isrOverhead = 0;
+	isrOverhead = isr_cycles();
+
+#ifdef SFX_DDS
+	bench_dds();
+#else
+	bench_field("empty", 0, 0);
+	bench_field("full", MAX_ASTEROIDS, 0);
+	bench_field("projectiles", 4, MAX_PROJECTILES);
+	bench_scroll();
+	bench_poll();
+	bench_tick();
+	bench_uart();
+	bench_receive();
+	bench_eeprom();
+#endif
+
+	put_string("BENCH done\n");
+	cli();
+	sleep_enable();
+	sleep_cpu();
+	while(1) {
+	}
+}
+
+/****************** INTERNAL FUNCTIONS *********************/
+
+/* isr_cycles()
+**  - lets the highest priority pending interrupt run (the instruction
+**    after sei() is always run first, then the handler, then one more
+**    instruction - the cli()) and returns the cycles its handler took.
+*/
+static uint16_t isr_cycles(void)
+{
+	uint16_t start, end;
+
+	start = CYCLE_COUNT;
+	sei();
+	asm volatile("nop");
+	cli();
+	end = CYCLE_COUNT;
+	return end - start - isrOverhead;
+}
+
+#ifdef SFX_DDS
+
+/* bench_dds()
+**  - plays a note on every voice and runs the sample interrupt
+**    handler for BENCH_SAMPLES samples.
+*/
+static void bench_dds(void)
+{
+	uint16_t cycles, longest = 0;
+	uint8_t i;
+
+	init_dds();
+	for(i=0; i < DDS_VOICES; i++) {
+		dds_note_on(i, NOTE_A5, DDS_WAVE_SINE);
+	}
+	for(i=0; i < BENCH_SAMPLES; i++) {
+		while(!(TIFR & (1<<TOV1))) {
+		}
+		cycles = isr_cycles();
+		if(cycles > longest) {
+			longest = cycles;
+		}
+	}
+	TIMSK &= ~(1<<TOIE1);
+	report("TIMER1_OVF_vect", "dds_" EXPANDED_STRING(DDS_SAMPLE_RATE)
+			"x" EXPANDED_STRING(DDS_VOICES), longest);
+}
+
+#else
+
+/* set_field()
+**  - sets up the game field with the base in the centre, the given
+**    number of asteroids filling the field from the top row down, and
+**    the given number of projectiles, each in a different column,
+**    from the row above the base up.
+*/
+static void set_field(uint8_t asteroidCount, uint8_t projectileCount)
+{
+	uint8_t i;
+
+	basePosition = 3;
+	setHealth(4);
+	numAsteroids = asteroidCount;
+	for(i=0; i < asteroidCount; i++) {
+		asteroids[i] = ((i % FIELD_WIDTH) << 4) |
+				(FIELD_HEIGHT - 1 - i / FIELD_WIDTH);
+	}
+	numProjectiles = projectileCount;
+	for(i=0; i < projectileCount; i++) {
+		projectiles[i] = ((i * 2) << 4) | (2 + i);
+	}
+}
+
+/* bench_field()
+**  - measures the functions that work on the game field with the
+**    given field.
+*/
+static void bench_field(const char* scenario, uint8_t asteroidCount,
+		uint8_t projectileCount)
+{
+	uint16_t cycles, longest;
+	uint8_t i;
+
+	set_field(asteroidCount, projectileCount);
+	CYCLES(cycles, advance_asteroids());
+	report("advance_asteroids", scenario, cycles);
+
+	set_field(asteroidCount, projectileCount);
+	CYCLES(cycles, advance_projectiles());
+	report("advance_projectiles", scenario, cycles);
+
+	set_field(asteroidCount, projectileCount);
+	CYCLES(cycles, copy_game_field_to_led_display());
+	report("copy_game_field_to_led_display", scenario, cycles);
+
+	longest = 0;
+	for(i=0; i < NUM_ROWS; i++) {
+		CYCLES(cycles, display_row());
+		if(cycles > longest) {
+			longest = cycles;
+		}
+	}
+	report("display_row", scenario, longest);
+}
+
+/* bench_scroll()
+**  - scrolls a message (including letters, digits and spaces) until
+**    the display is blank.
+*/
+static void bench_scroll(void)
+{
+	uint16_t cycles, longest = 0;
+	uint8_t scrolling;
+
+	set_display_text("GAME OVER 2048");
+	do {
+		CYCLES(cycles, scrolling = scroll_display());
+		if(cycles > longest) {
+			longest = cycles;
+		}
+	} while(scrolling);
+	report("scroll_display", "scroll", longest);
+}
+
+/* bench_poll()
+**  - updates the joystick, running the SPI and timer 0 (byte delay)
+**    interrupt handlers for each byte as their interrupts occur.
+*/
+static void bench_poll(void)
+{
+	uint16_t cycles, spiLongest = 0, delayLongest = 0;
+
+	CYCLES(cycles, joystick_update());
+	report("joystick_update", "poll", cycles);
+
+	while(1) {
+		if(TIFR & (1<<OCF0)) {
+			/* The timer 0 interrupt has the higher priority */
+			cycles = isr_cycles();
+			if(cycles > delayLongest) {
+				delayLongest = cycles;
+			}
+		} else if(SPSR & (1<<SPIF)) {
+			cycles = isr_cycles();
+			if(cycles > spiLongest) {
+				spiLongest = cycles;
+			}
+		} else if(!(PORTB & 0x01)) {
+			/* Transfer still in progress (the joystick's chip
+			** select line is low)
+			*/
+			continue;
+		} else {
+			break;
+		}
+	}
+	report("SPI_STC_vect", "poll", spiLongest);
+	report("TIMER0_COMP_vect", "poll", delayLongest);
+}
+
+/* bench_tick()
+**  - runs timer 2 (the clock tick) for BENCH_TICKS ticks, with a
+**    sound effect playing, then stops it again.
+*/
+static void bench_tick(void)
+{
+	uint16_t cycles, longest = 0;
+	uint8_t i;
+
+	sfx_trigger(SFX_FIRE);
+	init_timer2();
+	for(i=0; i < BENCH_TICKS; i++) {
+		while(!(TIFR & (1<<OCF2))) {
+		}
+		cycles = isr_cycles();
+		if(cycles > longest) {
+			longest = cycles;
+		}
+	}
+	TCCR2 = 0;
+	TIMSK &= ~(1<<OCIE2);
+	hal_clear_timer_flags(1<<OCF2);
+	stop_tone();
+	report("TIMER2_COMP_vect", "tick", longest);
+}
+
+/* bench_uart()
+**  - sends a frame, running the serial transmit interrupt handler for
+**    each byte.
+*/
+static void bench_uart(void)
+{
+	static const uint8_t payload[16] = {0};
+	uint16_t cycles, longest = 0;
+
+	uart_send_frame(FRAME_TELEMETRY, payload, sizeof(payload));
+	while(UCSR0B & (1<<UDRIE0)) {
+		while(!(UCSR0A & (1<<UDRE0))) {
+		}
+		cycles = isr_cycles();
+		if(cycles > longest) {
+			longest = cycles;
+		}
+	}
+	/* Start the results on a new line */
+	put_char('\n');
+	report("USART0_UDRE_vect", "send", longest);
+}
+
+/* bench_receive()
+**  - runs the serial receive interrupt handler for one more byte than
+**    the receive buffer holds, so the longest time includes a byte
+**    being dropped. The handler is called directly (simavr can't be
+**    given serial input) and takes whatever is in UDR0. The call
+**    takes as long as the interrupt response, but the jump in the
+**    vector table (3 cycles) isn't counted.
+*/
+static void bench_receive(void)
+{
+	uint16_t cycles, longest = 0;
+	uint8_t i;
+
+	for(i=0; i <= UART_RX_BUFFER_SIZE; i++) {
+		CYCLES(cycles, CALL_VECTOR(USART0_RX_vect));
+		if(cycles > longest) {
+			longest = cycles;
+		}
+	}
+	report("USART0_RX_vect", "receive", longest);
+}
+
+/* bench_eeprom()
+**  - saves a record, running the EEPROM ready interrupt handler for
+**    each byte. (The interrupt is pending whenever no EEPROM write is
+**    in progress and the handler has left it on.)
+*/
+static void bench_eeprom(void)
+{
+	PersistData data = {1234, {1, 2, 3, 4}};
+	uint16_t cycles, longest = 0;
+
+	persist_save(&data);
+	while(EECR & (1<<EERIE)) {
+		while(EECR & (1<<EEWE)) {
+		}
+		cycles = isr_cycles();
+		if(cycles > longest) {
+			longest = cycles;
+		}
+	}
+	report("EE_READY_vect", "save", longest);
+}
+
+#endif
+
+/* report()
+**  - sends "BENCH name/scenario cycles".
+*/
+static void report(const char* name, const char* scenario,
+		uint16_t cycles)
+{
+	char digits[6];
+	uint8_t i = 0;
+
+	put_string("BENCH ");
+	put_string(name);
+	put_char('/');
+	put_string(scenario);
+	put_char(' ');
+	do {
+		digits[i++] = '0' + cycles % 10;
+		cycles /= 10;
+	} while(cycles);
+	while(i > 0) {
+		put_char(digits[--i]);
+	}
+	put_char('\n');
+}
+
+/* put_char() / put_string()
+**  - send over the serial port, waiting for room (interrupts are off,
+**    so the buffered driver in uart.c can't be used).
+*/
+static void put_char(char c)
+{
+	while(!(UCSR0A & (1<<UDRE0))) {
+	}
+	UDR0 = c;
+}
+
+static void put_string(const char* string)
+{
+	while(*string) {
+		put_char(*string++);
+	}
+}
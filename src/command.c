@@ -0,0 +1,426 @@
+/*
+** command.c
+**
+** Serial commands - see command.h.
+**
+** The parser is a state machine fed one byte at a time, so a frame
+** can arrive over several runs of the command task. A frame that
+** turns out to be bad (bad length or CRC) is thrown away and we look
+** for the next sync byte.
+*/
+
+#include <string.h>
+#include <util/crc16.h>
+#include "command.h"
+#include "uart.h"
+#include "scheduler.h"
+#include "joystick.h"
+#include "game.h"
+#include "score.h"
+#include "pmod.h"
+#include "project.h"
+#include "profile.h"
+#include "sampler.h"
+#include "isr_latency.h"
+#include "atomic_section.h"
+#include "input_latency.h"
+#include "trace.h"
+#include "autopilot.h"
+
+/* Parser states */
+#define WAIT_SYNC 0
+#define WAIT_TYPE 1
+#define WAIT_LENGTH 2
+#define WAIT_PAYLOAD 3
+#define WAIT_CRC 4
+
+/* Size of the reply header (command and status) */
+#define REPLY_HEADER 2
+
+/* Health a game starts with (see init_game_field() in game.c) */
+#define START_HEALTH 4
+
+/* The frame being received */
+static uint8_t state;
+static uint8_t frameType;
+static uint8_t frameLength;
+static uint8_t frameCount;		/* payload bytes received so far */
+static uint8_t frameCrc;
+static uint8_t payload[UART_MAX_PAYLOAD];
+
+/* The reply being built */
+static uint8_t reply[UART_MAX_PAYLOAD];
+static uint8_t replyLength;
+
+static uint16_t badFrames;
+
+/* Private functions - only used within this module */
+static void command_task(void);
+static void parse_byte(uint8_t byte);
+static void run_command(void);
+static uint8_t joystick_command(void);
+static uint8_t get_state_command(void);
+static uint8_t set_state_command(void);
+static uint8_t step_command(void);
+static uint8_t read_stats_command(void);
+static uint8_t reset_stats_command(void);
+static uint8_t trace_dump_command(void);
+static uint8_t positions_valid(const uint8_t* positions, uint8_t count);
+static void put_byte(uint8_t value);
+static void put_word(uint16_t value);
+static void put_long(uint32_t value);
+static void put_bytes(const void* data, uint8_t length);
+
+/* See comment in .h file */
+void init_command(void)
+{
+	state = WAIT_SYNC;
+	badFrames = 0;
+	add_task(command_task, COMMAND_PERIOD_MS, 0);
+}
+
+/* See comment in .h file */
+uint16_t command_get_bad_frames(void)
+{
+	return badFrames;
+}
+
+/****************** INTERNAL FUNCTIONS *********************/
+
+/* command_task()
+**  - parse the bytes received since we last ran. (There can't be more
+**    than the receive buffer holds, so this doesn't take long.)
+*/
+static void command_task(void)
+{
+	uint8_t byte;
+
+	while(uart_receive(&byte)) {
+		parse_byte(byte);
+	}
+}
+
+/* parse_byte()
+**  - add a received byte to the frame being received, and run the
+**    command if the frame is complete.
+*/
+static void parse_byte(uint8_t byte)
+{
+	switch(state) {
+		case WAIT_SYNC:
+			if(byte == UART_SYNC) {
+				state = WAIT_TYPE;
+			}
+			break;
+		case WAIT_TYPE:
+			frameType = byte;
+			frameCrc = _crc8_ccitt_update(0, byte);
+			state = WAIT_LENGTH;
+			break;
+		case WAIT_LENGTH:
+			if(byte > UART_MAX_PAYLOAD) {
+				badFrames++;
+				state = WAIT_SYNC;
+				break;
+			}
+			frameLength = byte;
+			frameCount = 0;
+			frameCrc = _crc8_ccitt_update(frameCrc, byte);
+			state = (byte == 0) ? WAIT_CRC : WAIT_PAYLOAD;
+			break;
+		case WAIT_PAYLOAD:
+			payload[frameCount++] = byte;
+			frameCrc = _crc8_ccitt_update(frameCrc, byte);
+			if(frameCount == frameLength) {
+				state = WAIT_CRC;
+			}
+			break;
+		case WAIT_CRC:
+			state = WAIT_SYNC;
+			if(byte != frameCrc) {
+				badFrames++;
+				break;
+			}
+			run_command();
+			break;
+	}
+}
+
+/* run_command()
+**  - carry out the command just received and send the reply. (If
+**    there isn't room to send the reply it is lost - the PC can ask
+**    again.)
+*/
+static void run_command(void)
+{
+	uint8_t status;
+
+	replyLength = REPLY_HEADER;
+	switch(frameType) {
+		case CMD_JOYSTICK:
+			status = joystick_command();
+			break;
+		case CMD_GET_STATE:
+			status = get_state_command();
+			break;
+		case CMD_SET_STATE:
+			status = set_state_command();
+			break;
+		case CMD_STEP:
+			status = step_command();
+			break;
+		case CMD_RUN:
+			release_game_logic();
+			status = CMD_OK;
+			break;
+		case CMD_READ_STATS:
+			status = read_stats_command();
+			break;
+		case CMD_RESET_STATS:
+			status = reset_stats_command();
+			break;
+		case CMD_TRACE_DUMP:
+			status = trace_dump_command();
+			break;
+		default:
+			status = CMD_UNKNOWN;
+			break;
+	}
+
+	/* Only send the reply data if the command worked */
+	if(status != CMD_OK) {
+		replyLength = REPLY_HEADER;
+	}
+	reply[0] = frameType;
+	reply[1] = status;
+	uart_send_frame(FRAME_REPLY, reply, replyLength);
+}
+
+static uint8_t joystick_command(void)
+{
+	int8_t x = payload[0];
+	int8_t y = payload[1];
+
+	if(frameLength == 0) {
+		joystick_release();
+		return CMD_OK;
+	}
+	if(frameLength != 3 || x < -2 || x > 2 || y < -2 || y > 2) {
+		return CMD_BAD_ARGUMENT;
+	}
+	joystick_override(x, y, payload[2]);
+	return CMD_OK;
+}
+
+static uint8_t get_state_command(void)
+{
+	put_word(get_score());
+	put_byte(getHealth());
+	put_byte(basePosition);
+	put_word(get_random_state());
+	put_byte(numProjectiles);
+	put_bytes(projectiles, numProjectiles);
+	put_byte(numAsteroids);
+	put_bytes(asteroids, numAsteroids);
+	put_word(game_logic_steps_left());
+	put_word(uart_get_lost_bytes());
+	put_word(badFrames);
+	return CMD_OK;
+}
+
+static uint8_t set_state_command(void)
+{
+	/* Offsets of the fields in the payload */
+	const uint8_t projectileCount = 6;
+	const uint8_t projectileList = 7;
+	uint8_t asteroidCount;
+	uint8_t* newProjectiles = &payload[projectileList];
+	uint8_t* newAsteroids;
+
+	/* Check everything before changing anything */
+	if(frameLength < projectileList
+			|| payload[projectileCount] > MAX_PROJECTILES) {
+		return CMD_BAD_ARGUMENT;
+	}
+	asteroidCount = projectileList + payload[projectileCount];
+	if(frameLength <= asteroidCount
+			|| payload[asteroidCount] > MAX_ASTEROIDS
+			|| frameLength != asteroidCount + 1 + payload[asteroidCount]
+			|| payload[2] < 1 || payload[2] > START_HEALTH
+			|| payload[3] >= FIELD_WIDTH) {
+		return CMD_BAD_ARGUMENT;
+	}
+	newAsteroids = &payload[asteroidCount + 1];
+	if(!positions_valid(newProjectiles, payload[projectileCount])
+			|| !positions_valid(newAsteroids, payload[asteroidCount])) {
+		return CMD_BAD_ARGUMENT;
+	}
+
+	set_score(payload[0] | (payload[1] << 8));
+	setHealth((int8_t)payload[2]);
+	basePosition = payload[3];
+	set_game_seed(payload[4] | (payload[5] << 8));
+	/* (The autopilot, if it is playing, is seeded the same way) */
+	init_autopilot();
+	numProjectiles = payload[projectileCount];
+	memcpy(projectiles, newProjectiles, numProjectiles);
+	numAsteroids = payload[asteroidCount];
+	memcpy(asteroids, newAsteroids, numAsteroids);
+
+	copy_game_field_to_led_display();
+	outputHealth(getHealth());
+	return CMD_OK;
+}
+
+static uint8_t step_command(void)
+{
+	if(frameLength != 2) {
+		return CMD_BAD_ARGUMENT;
+	}
+	step_game_logic(payload[0] | (payload[1] << 8));
+	return CMD_OK;
+}
+
+static uint8_t read_stats_command(void)
+{
+	uint8_t kind = payload[0];
+	uint8_t index = payload[1];
+	uint8_t valid = 0;
+
+	if(frameLength != 2) {
+		return CMD_BAD_ARGUMENT;
+	}
+	put_byte(kind);
+	put_byte(index);
+
+	switch(kind) {
+		case STATS_PROFILE: {
+#ifdef PROFILE
+			ProfileStats stats;
+
+			valid = profile_get(index, &stats);
+			put_bytes(&stats, sizeof(stats));
+			break;
+#else
+			return CMD_UNSUPPORTED;
+#endif
+		}
+		case STATS_SAMPLER:
+#ifdef SAMPLE_PROFILE
+			valid = (index < SAMPLE_BUCKETS);
+			put_word(sampler_get_bucket(index));
+			put_long(sampler_get_total());
+			break;
+#else
+			return CMD_UNSUPPORTED;
+#endif
+		case STATS_LATENCY: {
+#ifdef ISR_LATENCY
+			IsrLatencyStats stats;
+
+			valid = isr_latency_get(index, &stats);
+			put_bytes(&stats, sizeof(stats));
+			break;
+#else
+			return CMD_UNSUPPORTED;
+#endif
+		}
+		case STATS_ATOMIC: {
+#ifdef ATOMIC_TRACE
+			uint16_t maxCycles;
+			uint32_t totalCycles;
+			uint32_t count;
+
+			valid = atomic_get_stats(index, &maxCycles, &totalCycles, &count);
+			put_word(maxCycles);
+			put_long(totalCycles);
+			put_long(count);
+			break;
+#else
+			return CMD_UNSUPPORTED;
+#endif
+		}
+		case STATS_INPUT_LATENCY: {
+#ifdef INPUT_LATENCY
+			InputLatencyStats stats;
+
+			valid = input_latency_get(index, &stats);
+			put_bytes(&stats, sizeof(stats));
+			break;
+#else
+			return CMD_UNSUPPORTED;
+#endif
+		}
+	}
+	return valid ? CMD_OK : CMD_BAD_ARGUMENT;
+}
+
+static uint8_t reset_stats_command(void)
+{
+	profile_reset();
+#ifdef SAMPLE_PROFILE
+	sampler_reset();
+#endif
+	isr_latency_reset();
+	input_latency_reset();
+	return CMD_OK;
+}
+
+static uint8_t trace_dump_command(void)
+{
+#ifdef TRACE
+	/* (The dump task doesn't run until after our reply is sent) */
+	return trace_dump_start() ? CMD_OK : CMD_BAD_ARGUMENT;
+#else
+	return CMD_UNSUPPORTED;
+#endif
+}
+
+/* positions_valid()
+**  - returns 1 if the given projectile or asteroid positions are all
+**    on the field and no two are the same, 0 otherwise.
+*/
+static uint8_t positions_valid(const uint8_t* positions, uint8_t count)
+{
+	uint8_t i, j;
+
+	for(i = 0; i < count; i++) {
+		if((positions[i] >> 4) >= FIELD_WIDTH
+				|| (positions[i] & 0x0F) >= FIELD_HEIGHT) {
+			return 0;
+		}
+		for(j = 0; j < i; j++) {
+			if(positions[j] == positions[i]) {
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+/* put_byte() etc.
+**  - add values to the reply. (Replies are always short enough to
+**    fit in a frame.)
+*/
+static void put_byte(uint8_t value)
+{
+	reply[replyLength++] = value;
+}
+
+static void put_word(uint16_t value)
+{
+	put_byte(value & 0xFF);
+	put_byte(value >> 8);
+}
+
+static void put_long(uint32_t value)
+{
+	put_word(value & 0xFFFF);
+	put_word(value >> 16);
+}
+
+static void put_bytes(const void* data, uint8_t length)
+{
+	memcpy(&reply[replyLength], data, length);
+	replyLength += length;
+}
@@ -0,0 +1,124 @@
+/*
+** command.h
+**
+** Commands sent to the board over the serial port, so that tests and
+** benchmarks can be run from a PC without anyone touching the board
+** (see tools/board_command.py).
+**
+** Commands are sent in frames like the ones the board sends (see
+** uart.h), with the command (CMD_JOYSTICK etc.) as the frame type.
+** Bytes are taken from the serial receive buffer and parsed a few at
+** a time by a task every COMMAND_PERIOD_MS milliseconds, so commands
+** never hold up the game. Frames with a bad CRC are ignored.
+**
+** Each command is answered with a FRAME_REPLY frame:
+**
+**		command, status (CMD_OK etc.), reply data (if any)
+**
+** Multi-byte values are little endian. The commands are:
+**
+** CMD_JOYSTICK: x (-2 to 2), y (-2 to 2), buttons (see joystick.h)
+**		Report this joystick position and buttons instead of the real
+**		ones. With no data, go back to the real joystick.
+**
+** CMD_GET_STATE: no data
+**		Reply data is the game state (see below) followed by the
+**		number of logic steps still to be run (2 bytes - see
+**		CMD_STEP), the number of received bytes lost (2 bytes - see
+**		uart_get_lost_bytes()) and the number of bad frames thrown
+**		away (2 bytes - see command_get_bad_frames()). The seed is
+**		the random number generator's current state (see
+**		get_random_state() in game.h), so sending the state back
+**		with CMD_SET_STATE carries on the same game.
+**
+** CMD_SET_STATE: game state
+**		Replace the game state. The random number generator (and
+**		the autopilot's, if it is compiled in - see autopilot.h)
+**		is seeded with the seed given. The status is CMD_BAD_ARGUMENT
+**		(and nothing is changed) if the health isn't 1 to 4, or
+**		anything is off the field, or two projectiles or two
+**		asteroids are in the same place.
+**
+**		The game state is: score (2 bytes), health, base position,
+**		random number seed (2 bytes), number of projectiles, the
+**		projectiles, number of asteroids, the asteroids. Positions are
+**		as stored in game.c (x in the upper 4 bits, y in the lower 4).
+**
+** CMD_STEP: number of steps (2 bytes)
+**		Stop the game logic following real time and run the given
+**		number of logic steps (LOGIC_TICK_MS each - see game.h). The
+**		reply is sent straight away; CMD_GET_STATE shows when the
+**		steps have been run. 0 steps just stops the game.
+**
+** CMD_RUN: no data
+**		Let the game logic follow real time again.
+**
+** CMD_READ_STATS: kind (STATS_PROFILE etc.), index
+**		Reply data is the kind and index, followed by:
+**		- STATS_PROFILE: the ProfileStats of probe "index"
+**		  (see profile.h)
+**		- STATS_SAMPLER: the count of bucket "index" (2 bytes) and
+**		  the total number of samples (4 bytes) (see sampler.h)
+**		- STATS_LATENCY: the IsrLatencyStats of interrupt "index"
+**		  (see isr_latency.h)
+**		- STATS_ATOMIC: the longest time (2 bytes), total time (4
+**		  bytes) and count (4 bytes) of interrupts-off site "index"
+**		  (see atomic_section.h)
+**		- STATS_INPUT_LATENCY: the InputLatencyStats of stage
+**		  "index" (see input_latency.h)
+**		The status is CMD_UNSUPPORTED if that kind of profiling was
+**		not compiled in.
+**
+** CMD_TRACE_DUMP: no data
+**		Send the timeline trace (see trace.h) after the reply. The
+**		status is CMD_UNSUPPORTED if tracing was not compiled in,
+**		or CMD_BAD_ARGUMENT if the trace is already being sent.
+**
+** CMD_RESET_STATS: no data
+**		Clear the profile, sampler, interrupt latency and input
+**		latency statistics (those that are compiled in).
+*/
+
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <stdint.h>
+
+#define COMMAND_PERIOD_MS 5
+
+/* Commands */
+#define CMD_JOYSTICK 0x40
+#define CMD_GET_STATE 0x41
+#define CMD_SET_STATE 0x42
+#define CMD_STEP 0x43
+#define CMD_RUN 0x44
+#define CMD_READ_STATS 0x45
+#define CMD_RESET_STATS 0x46
+#define CMD_TRACE_DUMP 0x47
+
+/* Reply status */
+#define CMD_OK 0
+#define CMD_UNKNOWN 1			/* not a command we know */
+#define CMD_BAD_ARGUMENT 2		/* wrong length or value out of range */
+#define CMD_UNSUPPORTED 3		/* not compiled in */
+
+/* Kinds of statistics for CMD_READ_STATS */
+#define STATS_PROFILE 0
+#define STATS_SAMPLER 1
+#define STATS_LATENCY 2
+#define STATS_ATOMIC 3
+#define STATS_INPUT_LATENCY 4
+
+/* init_command()
+** - starts accepting commands. The serial port and the scheduler
+** must already be initialised.
+*/
+void init_command(void);
+
+/* command_get_bad_frames()
+** - returns the number of frames ignored because of a bad CRC or
+** length.
+*/
+uint16_t command_get_bad_frames(void);
+
+#endif
@@ -0,0 +1,253 @@
+/*
+** dds.c
+**
+** DDS sound engine - see dds.h.
+**
+** Each voice has a 16 bit phase accumulator. Every sample period the
+** voice's phase increment (which sets its frequency) is added to the
+** accumulator and the top 8 bits of the accumulator are used to look
+** up the voice's wavetable. The samples of the voices are added
+** together and written to the PWM compare register.
+**
+** Timer 1 runs in fast PWM mode with TOP set by ICR1, so the PWM
+** frequency is the sample rate. At 15625Hz the PWM has 9 bits of
+** resolution (TOP = 511), which is exactly enough for the sum of two
+** 8 bit samples. At 31250Hz it has 8 bits (TOP = 255).
+**
+** The sample interrupt has a lower priority than the timer 2 tick
+** interrupt (see timer2.c). The jobs run from the tick interrupt
+** may take up to 640 cycles, which can delay a sample by a period at
+** 15625Hz (two at 31250Hz). This is heard as a little jitter but no
+** samples are lost. In turn the sample interrupt can delay the tick
+** interrupt (and the SPI interrupts) by up to DDS_ISR_BUDGET cycles
+** (about 20 microseconds), which is well within their tolerances.
+*/
+
+#include "hal.h"
+#include "dds.h"
+#include "sfx.h"
+#include "isr_latency.h"
+#include "atomic_section.h"
+
+#ifdef SFX_DDS
+
+/* Configuration-specific settings. PWM_TOP is the timer 1 TOP
+** value (one less than the number of CPU cycles per sample) and
+** MIX() converts the sum of the voice samples to a compare value.
+*/
+#if DDS_SAMPLE_RATE == 15625
+#define PWM_TOP 511
+#if DDS_VOICES == 2
+#define MIX(sum) (sum)
+#else
+#define MIX(sum) ((sum) << 1)
+#endif
+#elif DDS_SAMPLE_RATE == 31250
+#define PWM_TOP 255
+#if DDS_VOICES == 2
+#define MIX(sum) ((sum) >> 1)
+#else
+#define MIX(sum) (sum)
+#endif
+#else
+#error "DDS_SAMPLE_RATE must be 15625 or 31250"
+#endif
+
+#if DDS_VOICES != 1 && DDS_VOICES != 2
+#error "DDS_VOICES must be 1 or 2"
+#endif
+
+/* (DDS_ISR_BUDGET is an estimate - see dds.h - so a configuration
+** close to the limit may still be rejected by "make bench".)
+*/
+#if DDS_ISR_BUDGET * DDS_SAMPLE_RATE > 8000000UL / 2
+#error "DDS configuration would use more than half of the CPU"
+#endif
+
+/* Phase increment for each note (NOTE_C4 etc.) at our sample rate.
+** The increment for frequency f is f * 65536 / DDS_SAMPLE_RATE -
+** this is worked out by the compiler.
+*/
+#define NOTE_INC(f) ((uint16_t)((f) * 65536.0 / DDS_SAMPLE_RATE + 0.5))
+
+static const uint16_t notePhaseIncrements[NUM_NOTES] PROGMEM = {
+	NOTE_INC(261.63), NOTE_INC(277.18), NOTE_INC(293.66), NOTE_INC(311.13),	/* C4 CS4 D4 DS4 */
+	NOTE_INC(329.63), NOTE_INC(349.23), NOTE_INC(369.99), NOTE_INC(392.00),	/* E4 F4 FS4 G4 */
+	NOTE_INC(415.30), NOTE_INC(440.00), NOTE_INC(466.16), NOTE_INC(493.88),	/* GS4 A4 AS4 B4 */
+	NOTE_INC(523.25), NOTE_INC(554.37), NOTE_INC(587.33), NOTE_INC(622.25),	/* C5 CS5 D5 DS5 */
+	NOTE_INC(659.26), NOTE_INC(698.46), NOTE_INC(739.99), NOTE_INC(783.99),	/* E5 F5 FS5 G5 */
+	NOTE_INC(830.61), NOTE_INC(880.00), NOTE_INC(932.33), NOTE_INC(987.77),	/* GS5 A5 AS5 B5 */
+	NOTE_INC(1046.50), NOTE_INC(1108.73), NOTE_INC(1174.66), NOTE_INC(1244.51),	/* C6 CS6 D6 DS6 */
+	NOTE_INC(1318.51), NOTE_INC(1396.91), NOTE_INC(1479.98), NOTE_INC(1567.98),	/* E6 F6 FS6 G6 */
+	NOTE_INC(1661.22), NOTE_INC(1760.00), NOTE_INC(1864.66), NOTE_INC(1975.53)	/* GS6 A6 AS6 B6 */
+};
+
+/* Wavetables - one cycle of each waveform, 256 unsigned samples
+** centred on 128. Each starts at 128 so that a voice which is
+** stopped (phase 0) outputs the mid level.
+*/
+static const uint8_t sineWave[256] PROGMEM = {
+	128, 131, 134, 137, 140, 144, 147, 150, 153, 156, 159, 162, 165, 168, 171, 174,
+	177, 179, 182, 185, 188, 191, 193, 196, 199, 201, 204, 206, 209, 211, 213, 216,
+	218, 220, 222, 224, 226, 228, 230, 232, 234, 235, 237, 239, 240, 241, 243, 244,
+	245, 246, 248, 249, 250, 250, 251, 252, 253, 253, 254, 254, 254, 255, 255, 255,
+	255, 255, 255, 255, 254, 254, 254, 253, 253, 252, 251, 250, 250, 249, 248, 246,
+	245, 244, 243, 241, 240, 239, 237, 235, 234, 232, 230, 228, 226, 224, 222, 220,
+	218, 216, 213, 211, 209, 206, 204, 201, 199, 196, 193, 191, 188, 185, 182, 179,
+	177, 174, 171, 168, 165, 162, 159, 156, 153, 150, 147, 144, 140, 137, 134, 131,
+	128, 125, 122, 119, 116, 112, 109, 106, 103, 100,  97,  94,  91,  88,  85,  82,
+	 79,  77,  74,  71,  68,  65,  63,  60,  57,  55,  52,  50,  47,  45,  43,  40,
+	 38,  36,  34,  32,  30,  28,  26,  24,  22,  21,  19,  17,  16,  15,  13,  12,
+	 11,  10,   8,   7,   6,   6,   5,   4,   3,   3,   2,   2,   2,   1,   1,   1,
+	  1,   1,   1,   1,   2,   2,   2,   3,   3,   4,   5,   6,   6,   7,   8,  10,
+	 11,  12,  13,  15,  16,  17,  19,  21,  22,  24,  26,  28,  30,  32,  34,  36,
+	 38,  40,  43,  45,  47,  50,  52,  55,  57,  60,  63,  65,  68,  71,  74,  77,
+	 79,  82,  85,  88,  91,  94,  97, 100, 103, 106, 109, 112, 116, 119, 122, 125
+};
+
+static const uint8_t triangleWave[256] PROGMEM = {
+	128, 130, 132, 134, 136, 138, 140, 142, 144, 146, 148, 150, 152, 154, 156, 158,
+	160, 162, 164, 166, 168, 170, 172, 174, 176, 178, 180, 182, 184, 186, 188, 190,
+	192, 194, 196, 198, 200, 202, 204, 206, 208, 210, 212, 214, 216, 218, 220, 222,
+	224, 226, 228, 230, 232, 234, 236, 238, 240, 242, 244, 246, 248, 250, 252, 254,
+	255, 253, 251, 249, 247, 245, 243, 241, 239, 237, 235, 233, 231, 229, 227, 225,
+	223, 221, 219, 217, 215, 213, 211, 209, 207, 205, 203, 201, 199, 197, 195, 193,
+	191, 189, 187, 185, 183, 181, 179, 177, 175, 173, 171, 169, 167, 165, 163, 161,
+	159, 157, 155, 153, 151, 149, 147, 145, 143, 141, 139, 137, 135, 133, 131, 129,
+	127, 125, 123, 121, 119, 117, 115, 113, 111, 109, 107, 105, 103, 101,  99,  97,
+	 95,  93,  91,  89,  87,  85,  83,  81,  79,  77,  75,  73,  71,  69,  67,  65,
+	 63,  61,  59,  57,  55,  53,  51,  49,  47,  45,  43,  41,  39,  37,  35,  33,
+	 31,  29,  27,  25,  23,  21,  19,  17,  15,  13,  11,   9,   7,   5,   3,   1,
+	  0,   2,   4,   6,   8,  10,  12,  14,  16,  18,  20,  22,  24,  26,  28,  30,
+	 32,  34,  36,  38,  40,  42,  44,  46,  48,  50,  52,  54,  56,  58,  60,  62,
+	 64,  66,  68,  70,  72,  74,  76,  78,  80,  82,  84,  86,  88,  90,  92,  94,
+	 96,  98, 100, 102, 104, 106, 108, 110, 112, 114, 116, 118, 120, 122, 124, 126
+};
+
+static const uint8_t sawtoothWave[256] PROGMEM = {
+	128, 129, 130, 131, 132, 133, 134, 135, 136, 137, 138, 139, 140, 141, 142, 143,
+	144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159,
+	160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175,
+	176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191,
+	192, 193, 194, 195, 196, 197, 198, 199, 200, 201, 202, 203, 204, 205, 206, 207,
+	208, 209, 210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223,
+	224, 225, 226, 227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239,
+	240, 241, 242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255,
+	  0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,  15,
+	 16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27,  28,  29,  30,  31,
+	 32,  33,  34,  35,  36,  37,  38,  39,  40,  41,  42,  43,  44,  45,  46,  47,
+	 48,  49,  50,  51,  52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,
+	 64,  65,  66,  67,  68,  69,  70,  71,  72,  73,  74,  75,  76,  77,  78,  79,
+	 80,  81,  82,  83,  84,  85,  86,  87,  88,  89,  90,  91,  92,  93,  94,  95,
+	 96,  97,  98,  99, 100, 101, 102, 103, 104, 105, 106, 107, 108, 109, 110, 111,
+	112, 113, 114, 115, 116, 117, 118, 119, 120, 121, 122, 123, 124, 125, 126, 127
+};
+
+static const uint8_t* const waveforms[] PROGMEM = {
+	sineWave, triangleWave, sawtoothWave
+};
+
+/* Voice state. These are read by the sample interrupt handler so
+** are only changed with interrupts off.
+*/
+static uint16_t phase[DDS_VOICES];
+static uint16_t phaseIncrement[DDS_VOICES];
+static const uint8_t* wavetable[DDS_VOICES];
+
+/* Longest time taken (see dds_get_max_cycles()) */
+static volatile uint16_t maxCycles;
+
+/* See comment in .h file */
+void init_dds(void) {
+	uint8_t i;
+
+	for(i=0; i < DDS_VOICES; i++) {
+		phase[i] = 0;
+		phaseIncrement[i] = 0;
+		wavetable[i] = sineWave;
+	}
+	maxCycles = 0;
+
+	/* PWM output is OC1A (PB5) */
+	DDRB |= (1<<5);
+
+	/* Fast PWM with TOP = ICR1 (mode 14), OC1A cleared on compare
+	** match and set at BOTTOM, no clock prescaling. Start at the
+	** mid level. The overflow interrupt (at TOP) is our sample
+	** interrupt.
+	*/
+	ICR1 = PWM_TOP;
+	OCR1A = (PWM_TOP + 1) / 2;
+	TCNT1 = 0;
+	TCCR1A = (1<<COM1A1)|(1<<WGM11);
+	TCCR1B = (1<<WGM13)|(1<<WGM12)|(1<<CS10);
+	TIMSK |= (1<<TOIE1);
+}
+
+/* See comment in .h file */
+void dds_note_on(uint8_t voice, uint8_t note, uint8_t waveform) {
+	if(voice >= DDS_VOICES || note >= NUM_NOTES ||
+			waveform > DDS_WAVE_SAWTOOTH) {
+		return;
+	}
+	uint16_t increment = pgm_read_word(&notePhaseIncrements[note]);
+	const uint8_t* table =
+			(const uint8_t*)pgm_read_word(&waveforms[waveform]);
+
+	ATOMIC_SECTION(ATOMIC_DDS_VOICE) {
+		phaseIncrement[voice] = increment;
+		wavetable[voice] = table;
+	}
+}
+
+/* See comment in .h file */
+void dds_note_off(uint8_t voice) {
+	if(voice >= DDS_VOICES) {
+		return;
+	}
+	/* Stopping at phase 0 leaves the voice at the mid level */
+	ATOMIC_SECTION(ATOMIC_DDS_VOICE) {
+		phaseIncrement[voice] = 0;
+		phase[voice] = 0;
+	}
+}
+
+/* See comment in .h file */
+uint16_t dds_get_max_cycles(void) {
+	uint16_t cycles;
+
+	ATOMIC_SECTION(ATOMIC_DDS_STATS) {
+		cycles = maxCycles;
+	}
+	return cycles;
+}
+
+/* Sample interrupt - timer 1 has reached TOP. The compare value
+** we write now is used for the next PWM period. The voice code is
+** written out in full for each voice count so that no loop or
+** array indexing code is generated.
+*/
+ISR(TIMER1_OVF_vect) {
+	uint16_t sum;
+	uint16_t cycles;
+
+	ISR_LATENCY_RECORD(LATENCY_DDS_SAMPLE, TCNT1);
+
+	phase[0] += phaseIncrement[0];
+	sum = pgm_read_byte(wavetable[0] + (phase[0] >> 8));
+#if DDS_VOICES == 2
+	phase[1] += phaseIncrement[1];
+	sum += pgm_read_byte(wavetable[1] + (phase[1] >> 8));
+#endif
+	OCR1A = MIX(sum);
+
+	/* Timer 1 counts CPU cycles from 0 after TOP, so it tells us
+	** how long it is since the sample was due.
+	*/
+	cycles = TCNT1;
+	if(cycles > maxCycles) {
+		maxCycles = cycles;
+	}
+}
+
+#endif
@@ -0,0 +1,86 @@
+/*
+** dds.h
+**
+** Direct digital synthesis (DDS) sound engine. Up to two voices
+** are generated in software from wavetables in flash, mixed, and
+** output as the duty cycle of a fast PWM signal on OC1A (pin PB5).
+** With a simple RC low pass filter (or just the speaker) the PWM
+** output acts as a DAC.
+**
+** Timer 1 is used for the PWM output and the sample interrupt and
+** must not be used by other modules.
+**
+** The sample rate and number of voices are chosen at compile time
+** by defining DDS_SAMPLE_RATE (15625 or 31250) and DDS_VOICES (1 or
+** 2). The defaults are 15625Hz and 2 voices.
+**
+** Only compiled in if SFX_DDS is defined (see sfx.c).
+*/
+
+#ifndef DDS_H
+#define DDS_H
+
+#include <stdint.h>
+
+#ifndef DDS_SAMPLE_RATE
+#define DDS_SAMPLE_RATE 15625
+#endif
+
+#ifndef DDS_VOICES
+#define DDS_VOICES 2
+#endif
+
+/* Estimated worst case number of CPU cycles for the sample interrupt
+** handler (from the interrupt being taken to the end of the RETI)
+** with each number of voices. These were counted by hand from the
+** source, not measured - treat them as estimates until "make bench"
+** has been run on them. The sample rate only changes the mixing
+** shift, which is no slower at 31250Hz. "make bench" measures the
+** handler in each configuration and fails if it takes longer than
+** this (the TIMER1_OVF_vect/dds_* budgets in bench_budgets.txt must
+** be these figures - change them together).
+**
+** A sample is due every 8000000 / DDS_SAMPLE_RATE cycles (512 at
+** 15625Hz, 256 at 31250Hz), so at the default settings the
+** synthesiser should use about 27% of the CPU. Configurations that would
+** use more than half of the CPU (two voices at 31250Hz) are rejected
+** when compiling. dds_get_max_cycles() reports the time taken while
+** running, including any delay before the handler starts.
+*/
+#if DDS_VOICES == 1
+#define DDS_ISR_BUDGET 110
+#else
+#define DDS_ISR_BUDGET 140
+#endif
+
+/* Waveforms */
+#define DDS_WAVE_SINE 0
+#define DDS_WAVE_TRIANGLE 1
+#define DDS_WAVE_SAWTOOTH 2
+
+/* init_dds()
+** - sets up timer 1 and the OC1A pin and starts the sample
+** interrupt. All voices are silent.
+*/
+void init_dds(void);
+
+/* dds_note_on()
+** - start the given voice (0 to DDS_VOICES-1) playing the given
+** note (NOTE_C4 etc. - see sfx.h) with the given waveform.
+*/
+void dds_note_on(uint8_t voice, uint8_t note, uint8_t waveform);
+
+/* dds_note_off()
+** - silence the given voice.
+*/
+void dds_note_off(uint8_t voice);
+
+/* dds_get_max_cycles()
+** - returns the longest time (in CPU cycles) from the start of a
+** sample period to the end of the sample interrupt handler. This
+** includes any delay before the handler started (e.g. because
+** another interrupt handler was running).
+*/
+uint16_t dds_get_max_cycles(void);
+
+#endif
@@ -0,0 +1,135 @@
+/*
+** display_mirror.c
+**
+** Display streaming - see display_mirror.h.
+*/
+
+#include "display_mirror.h"
+#include "led_display.h"
+#include "uart.h"
+#include "scheduler.h"
+#include "timer2.h"
+
+#define UNCHANGED_RUN 0x80
+
+/* The display as the receiver last saw it */
+static uint16_t sentDisplay[NUM_ROWS];
+
+static uint8_t enabled;
+static uint8_t sequence;
+static uint8_t keyframeDue;
+static uint32_t lastKeyframeTime;
+
+/* Private functions - only used within this module */
+static void display_mirror_task(void);
+static uint8_t send_keyframe(const uint16_t* rows);
+static uint8_t send_delta(const uint16_t* rows);
+
+/* See comment in .h file */
+void init_display_mirror(void)
+{
+	sequence = 0;
+	display_mirror_enable(1);
+	add_task(display_mirror_task, DISPLAY_MIRROR_PERIOD_MS, 0);
+}
+
+/* See comment in .h file */
+void display_mirror_enable(uint8_t enable)
+{
+	enabled = enable;
+	keyframeDue = 1;
+}
+
+/****************** INTERNAL FUNCTIONS *********************/
+
+/* display_mirror_task()
+**  - send a frame if the display has changed (or a key frame is
+**    due).
+*/
+static void display_mirror_task(void)
+{
+	uint16_t rows[NUM_ROWS];
+	uint8_t changed = 0;
+	uint8_t sent;
+	uint8_t i;
+
+	if(!enabled) {
+		return;
+	}
+
+	/* display[] is only changed by the main program (not from
+	** interrupt handlers), so it can't change while we copy it.
+	*/
+	for(i=0; i < NUM_ROWS; i++) {
+		rows[i] = display[i];
+		changed |= (rows[i] != sentDisplay[i]);
+	}
+
+	if(deadline_reached(lastKeyframeTime + DISPLAY_MIRROR_KEYFRAME_MS)) {
+		keyframeDue = 1;
+	}
+	if(keyframeDue) {
+		sent = send_keyframe(rows);
+		if(sent) {
+			keyframeDue = 0;
+			lastKeyframeTime = get_clock_ticks();
+		}
+	} else if(changed) {
+		sent = send_delta(rows);
+	} else {
+		return;
+	}
+
+	if(sent) {
+		sequence++;
+		for(i=0; i < NUM_ROWS; i++) {
+			sentDisplay[i] = rows[i];
+		}
+	}
+}
+
+/* send_keyframe()
+**  - send the whole display. Returns 1 if the frame was sent.
+*/
+static uint8_t send_keyframe(const uint16_t* rows)
+{
+	uint8_t frame[1 + 2 * NUM_ROWS];
+	uint8_t i;
+
+	frame[0] = sequence;
+	for(i=0; i < NUM_ROWS; i++) {
+		frame[1 + 2 * i] = rows[i] & 0xFF;
+		frame[2 + 2 * i] = rows[i] >> 8;
+	}
+	return uart_send_frame(FRAME_DISPLAY_KEY, frame, sizeof(frame));
+}
+
+/* send_delta()
+**  - send the changes since the last frame sent. Returns 1 if the
+**    frame was sent.
+*/
+static uint8_t send_delta(const uint16_t* rows)
+{
+	uint8_t frame[1 + 2 * NUM_ROWS];
+	uint8_t length = 0;
+	uint8_t run = 0;
+	uint16_t change;
+	uint8_t i;
+
+	frame[length++] = sequence;
+	for(i=0; i < NUM_ROWS; i++) {
+		change = rows[i] ^ sentDisplay[i];
+		if(change == 0) {
+			run++;
+			continue;
+		}
+		if(run) {
+			frame[length++] = UNCHANGED_RUN | run;
+			run = 0;
+		}
+		frame[length++] = (change >> 8) & 0x7F;
+		frame[length++] = change & 0xFF;
+	}
+	/* (Trailing unchanged rows don't need a token) */
+	return uart_send_frame(FRAME_DISPLAY_DELTA, frame, length);
+}
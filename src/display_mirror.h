@@ -0,0 +1,48 @@
+/*
+** display_mirror.h
+**
+** Streams the contents of the LED display (display[] - see
+** led_display.h) over the serial port, so the game can be watched
+** on a PC (see tools/serial_monitor.py).
+**
+** The display is checked every DISPLAY_MIRROR_PERIOD_MS milliseconds
+** and a frame is only sent if it has changed. Most of the time only
+** one or two rows change, so frames are sent as the changes from the
+** previous frame (FRAME_DISPLAY_DELTA):
+**
+**		sequence number (1 byte), then tokens for rows 0 to 6:
+**		- 1nnnnnnn: the next n rows are unchanged
+**		- 0hhhhhhh llllllll: XOR the next row with 0xhhll
+**
+** (Rows only have 15 bits, so the top bit of a change is always 0.)
+** Every DISPLAY_MIRROR_KEYFRAME_MS milliseconds the whole display is
+** sent instead (FRAME_DISPLAY_KEY: sequence number then 7 rows, low
+** byte first) so that a receiver that starts late, or misses a
+** frame, can pick up the picture again.
+**
+** If a frame can't be sent because the serial buffer is full, the
+** next frame is worked out from the last frame actually sent, so
+** the receiver's picture stays correct.
+*/
+
+#ifndef DISPLAY_MIRROR_H
+#define DISPLAY_MIRROR_H
+
+#include <stdint.h>
+
+#define DISPLAY_MIRROR_PERIOD_MS 10
+#define DISPLAY_MIRROR_KEYFRAME_MS 2000
+
+/* init_display_mirror()
+** - starts streaming the display. The serial port and the scheduler
+** must already be initialised.
+*/
+void init_display_mirror(void);
+
+/* display_mirror_enable()
+** - turns streaming on (1) or off (0). Streaming restarts with a
+** key frame.
+*/
+void display_mirror_enable(uint8_t enabled);
+
+#endif
@@ -9,9 +9,12 @@
 #include "led_display.h"
 #include "score.h"
 #include "pmod.h"
-#include <stdlib.h>
-#include <avr/interrupt.h>
-/* Stdlib needed for rand() - random number generator */
+#include "sfx.h"
+#include "profile.h"
+#include "atomic_section.h"
+#include "input_latency.h"
+#include "trace.h"
+#include "hal.h"
 
 
 /*
@@ -39,12 +42,27 @@
 ** numAsteroids - 1.
 **
 */
-int8_t    basePosition;
-int8_t    numProjectiles;
-uint8_t    projectiles[MAX_PROJECTILES];
-int8_t    numAsteroids;
-uint8_t    asteroids[MAX_ASTEROIDS];
-int		  health;
+HAL_THREAD_LOCAL int8_t    basePosition;
+HAL_THREAD_LOCAL int8_t    numProjectiles;
+HAL_THREAD_LOCAL uint8_t    projectiles[MAX_PROJECTILES];
+HAL_THREAD_LOCAL int8_t    numAsteroids;
+HAL_THREAD_LOCAL uint8_t    asteroids[MAX_ASTEROIDS];
+HAL_THREAD_LOCAL int		  health;
+
+/*
+** Logic step counters (see game_step()) - the number of steps since
+** the projectiles / asteroids last advanced, and the number of steps
+** until the base moves again while the joystick is held to one side.
+*/
+static HAL_THREAD_LOCAL uint8_t  projectileSteps;
+static HAL_THREAD_LOCAL uint16_t asteroidSteps;
+static HAL_THREAD_LOCAL uint8_t  baseRepeatSteps;
+
+/* Last seed given to set_game_seed(), and the state of the random
+** number generator (never 0 - see game_random())
+*/
+static HAL_THREAD_LOCAL uint16_t gameSeed;
+static HAL_THREAD_LOCAL uint16_t randomState = 1;
 
 /************************************************************ 
 ** Prototypes for internal information functions 
@@ -66,6 +84,9 @@ static int8_t projectile_at(uint8_t x, uint8_t y);
 static void remove_asteroid(int8_t asteroidIndex);
 static void remove_projectile(int8_t projectileIndex);
 
+/* Returns the next pseudo random number (1 to 65535) */
+static uint16_t game_random(void);
+
 /*
 ** Asteroid / Projectile Maintenance Functions
 */
@@ -75,6 +96,9 @@ void handleBaseCollision();
 void replaceAsteroid();
 int8_t createAsteroid(int8_t x, int8_t y);
 
+/* Called when the base has no health left (see project.c) */
+void gameOver(void);
+
 /***********************************************************/
 
 /* 
@@ -97,12 +121,12 @@ void init_game_field(void) {
 			/* Generate random x position - somewhere from 0
 			** to FIELD_WIDTH - 1
 			*/
-			x = (uint8_t)(rand() % FIELD_WIDTH);
+			x = (uint8_t)(game_random() % FIELD_WIDTH);
 			/* Generate random y position - somewhere from 3
 			** to FIELD_HEIGHT - 1 (i.e., not in the lowest
 			** three rows)
 			*/
-			y = (uint8_t)(3 + (rand() % (FIELD_HEIGHT-3)));
+			y = (uint8_t)(3 + (game_random() % (FIELD_HEIGHT-3)));
 		} while(asteroid_at(x,y) != -1);
 		/* If we get here, we've now found an x,y location without
 		** an existing asteroid - record the position
@@ -112,6 +136,10 @@ void init_game_field(void) {
 	}
 	health = 4;
 	outputHealth(health);
+
+	projectileSteps = 0;
+	asteroidSteps = 0;
+	baseRepeatSteps = 0;
 }
 
 /* 
@@ -171,13 +199,10 @@ void copy_game_field_to_led_display(void) {
 	** and we don't want a semi-updated display variable 
 	** used for the update.
 	*/
-	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
-	cli();
-	for(i=0; i < FIELD_WIDTH; i++) {
-		display[i] = ledBoard[i];
-	}
-	if(interrupts_enabled) {
-		sei();
+	ATOMIC_SECTION(ATOMIC_COPY_FIELD) {
+		for(i=0; i < FIELD_WIDTH; i++) {
+			display[i] = ledBoard[i];
+		}
 	}
 }
 
@@ -219,6 +244,10 @@ int8_t fire_projectile(void) {
 			projectile_at(basePosition, 2) == -1) {
 		/* Have space to add projectile */
 		projectiles[numProjectiles++] = (basePosition<<4)|2;
+		sfx_trigger(SFX_FIRE);
+		/* (Field column x is LED display row x) */
+		INPUT_LATENCY_MARK(INPUT_FIRED, basePosition);
+		TRACE_INSTANT(TRACE_FIRE);
 		
 		// Check for collision with asteroid right in front of base station
 		int8_t asteroidIndex;
@@ -339,10 +368,53 @@ int8_t advance_asteroids(void) {
 	return asteroidsMoved;
 }
 
+/*
+** Advance the game by one logic step - see game.h.
+*/
+int8_t game_step(int8_t direction, uint8_t fire) {
+	int8_t fieldUpdated = 0;
+
+	/* Move the base straight away when the joystick is pushed
+	** to one side, then every BASE_REPEAT_TICKS steps while it
+	** is held there.
+	*/
+	if(direction == MOVE_NONE) {
+		baseRepeatSteps = 0;
+	} else if(baseRepeatSteps == 0) {
+		fieldUpdated |= move_base(direction);
+		baseRepeatSteps = BASE_REPEAT_TICKS - 1;
+	} else {
+		baseRepeatSteps--;
+	}
+
+	if(fire) {
+		fieldUpdated |= fire_projectile();
+	}
+
+	/* Advance any projectiles every PROJECTILE_TICKS steps (1s) */
+	if(++projectileSteps >= PROJECTILE_TICKS) {
+		PROFILE_BEGIN(PROF_ADVANCE_PROJECTILES);
+		fieldUpdated |= advance_projectiles();
+		PROFILE_END(PROF_ADVANCE_PROJECTILES);
+		projectileSteps = 0;
+	}
+
+	/* Advance any asteroids. The interval depends on the score. */
+	if(++asteroidSteps >= getAsteroidFallInterval() / LOGIC_TICK_MS) {
+		PROFILE_BEGIN(PROF_ADVANCE_ASTEROIDS);
+		fieldUpdated |= advance_asteroids();
+		PROFILE_END(PROF_ADVANCE_ASTEROIDS);
+		asteroidSteps = 0;
+	}
+
+	return fieldUpdated;
+}
+
 int getAsteroidFallInterval() {
-	int interval = 5000 - (get_score() * 100);
-	if (interval <= 500) {
-		interval = 500;
+	int interval = ASTEROID_FALL_START_MS -
+			(get_score() * ASTEROID_FALL_STEP_MS);
+	if (interval <= ASTEROID_FALL_MIN_MS) {
+		interval = ASTEROID_FALL_MIN_MS;
 	}
 	return interval;
 }
@@ -355,6 +427,20 @@ void setHealth(int newHealth) {
 	health = newHealth;
 }
 
+void set_game_seed(uint16_t seed) {
+	gameSeed = seed;
+	/* The generator never leaves 0, so seed 0 is taken as 1 */
+	randomState = seed ? seed : 1;
+}
+
+uint16_t get_game_seed(void) {
+	return gameSeed;
+}
+
+uint16_t get_random_state(void) {
+	return randomState;
+}
+
 
 
 /******** INTERNAL FUNCTIONS ****************/
@@ -368,6 +454,13 @@ void handleCollision(int8_t projectileIndex, int8_t asteroidIndex) {
 	
 	// Increase Score
 	add_to_score(1);
+
+	// Play a sound - a different one every 10 points
+	if (get_score() % 10 == 0) {
+		sfx_trigger(SFX_LEVEL_UP);
+	} else {
+		sfx_trigger(SFX_HIT);
+	}
 }
 
 void handleBaseCollision() {
@@ -380,6 +473,7 @@ void handleBaseCollision() {
 		remove_asteroid(asteroidIndex);
 		// Decrement Lives
 		health--;
+		sfx_trigger(SFX_BASE_DAMAGE);
 		
 		if (health <= 0) {
 			gameOver();
@@ -397,13 +491,20 @@ void replaceAsteroid() {
 	uint8_t newX = 0;
 	uint8_t newY = 14;
 	
-	numAsteroids;
+	// Give up if the top row is full - there is nowhere to put it
+	// (looking for a free position would never end)
+	while (newX < FIELD_WIDTH && asteroid_at(newX, newY) != -1) {
+		newX++;
+	}
+	if (newX == FIELD_WIDTH) {
+		return;
+	}
 	
 	if (numAsteroids < MAX_ASTEROIDS) {
 		// Find position that isn't occupied
 		do {
-			newX = (uint8_t)(rand() % FIELD_WIDTH);
-			//newY = (uint8_t)(3 + (rand() % (FIELD_HEIGHT-3)));
+			newX = (uint8_t)(game_random() % FIELD_WIDTH);
+			//newY = (uint8_t)(3 + (game_random() % (FIELD_HEIGHT-3)));
 		
 			asteroids[numAsteroids] = (newX<<4)|newY;	
 		} while (asteroid_at(newX, newY) != -1);
@@ -483,3 +584,17 @@ static void remove_projectile(int8_t projectileIndex) {
 	/* Last position in projectiles array is no longer used */
 	numProjectiles--;
 }
+
+/* 16 bit xorshift generator - cheap on the AVR (shifts and exclusive
+** ors only) and the same on every compiler, unlike rand(). Goes
+** through every value from 1 to 65535 before repeating.
+*/
+static uint16_t game_random(void) {
+	uint16_t x = randomState;
+
+	x ^= x << 7;
+	x ^= x >> 9;
+	x ^= x << 8;
+	randomState = x;
+	return x;
+}
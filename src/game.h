@@ -7,6 +7,7 @@
 */
 
 #include <inttypes.h>
+#include "hal.h"
 
 /*
 ** The game field is 15 rows in size by 7 columns, i.e. x (column number)
@@ -23,13 +24,52 @@
 ** there are tighter constraints than this - e.g. there are only 105
 ** positions on the game field.)
 */
+#ifndef MAX_PROJECTILES
 #define MAX_PROJECTILES 4
+#endif
+#ifndef MAX_ASTEROIDS
 #define MAX_ASTEROIDS 20
+#endif
 
 /* Arguments that can be passed to attempt_move() below */
 #define MOVE_LEFT 0
 #define MOVE_RIGHT 1
 
+/* Argument to game_step() when the base is not to move */
+#define MOVE_NONE -1
+
+/*
+** The game logic runs in fixed steps of LOGIC_TICK_MS milliseconds
+** (see game_step() below). Times in the game are multiples of this:
+** projectiles advance every PROJECTILE_TICKS steps and the base
+** moves every BASE_REPEAT_TICKS steps while the joystick is held
+** to one side.
+*/
+#define LOGIC_TICK_MS 10
+#ifndef PROJECTILE_TICKS
+#define PROJECTILE_TICKS (1000 / LOGIC_TICK_MS)
+#endif
+#define BASE_REPEAT_TICKS (250 / LOGIC_TICK_MS)
+
+/*
+** Asteroids fall a row every ASTEROID_FALL_START_MS at the start of
+** the game. Each point scored takes ASTEROID_FALL_STEP_MS off that,
+** down to ASTEROID_FALL_MIN_MS (see getAsteroidFallInterval()).
+**
+** These and the limits and times above that are in #ifndef can be
+** changed at compile time, e.g. to try out the game balance with the
+** host simulator (see host/monte_carlo.c).
+*/
+#ifndef ASTEROID_FALL_START_MS
+#define ASTEROID_FALL_START_MS 5000
+#endif
+#ifndef ASTEROID_FALL_STEP_MS
+#define ASTEROID_FALL_STEP_MS 100
+#endif
+#ifndef ASTEROID_FALL_MIN_MS
+#define ASTEROID_FALL_MIN_MS 500
+#endif
+
 /*
 ** Initialise the game field.
 */
@@ -59,6 +99,40 @@ int8_t advance_projectiles(void);
 */
 int8_t advance_asteroids(void);
 
+/*
+** Advance the game by one logic step (LOGIC_TICK_MS milliseconds).
+** "direction" is the direction the joystick is held (MOVE_LEFT,
+** MOVE_RIGHT or MOVE_NONE) and "fire" is true if the fire button
+** was pressed since the last step. The base moves as soon as the
+** joystick is pushed to one side and then every BASE_REPEAT_TICKS
+** steps; projectiles and asteroids advance when their intervals
+** have elapsed. Returns 1 if the game field changed, 0 otherwise.
+*/
+int8_t game_step(int8_t direction, uint8_t fire);
+
+/* The base position and the asteroids and projectiles on the game
+** field (see game.c).
+*/
+extern HAL_THREAD_LOCAL int8_t basePosition;
+extern HAL_THREAD_LOCAL int8_t numAsteroids;
+extern HAL_THREAD_LOCAL uint8_t asteroids[MAX_ASTEROIDS];
+extern HAL_THREAD_LOCAL int8_t numProjectiles;
+extern HAL_THREAD_LOCAL uint8_t projectiles[MAX_PROJECTILES];
+
+/*
+** Seed the random number generator used to place asteroids, so that
+** a game can be repeated. get_game_seed() returns the last seed set
+** (0 if none has been - the generator starts as if seeded with 1).
+** get_random_state() returns the generator's current state, which
+** moves on each time a random number is used: seeding with it
+** carries on the game from where it is now. The generator is game.c's own (not rand()), so a seed gives the
+** same game on the board and on the host, and each thread of the
+** host simulator has its own.
+*/
+void set_game_seed(uint16_t seed);
+uint16_t get_game_seed(void);
+uint16_t get_random_state(void);
+
 int getAsteroidFallInterval();
 int getHealth();
 void setHealth(int);
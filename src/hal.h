@@ -0,0 +1,43 @@
+/*
+** hal.h
+**
+** Hardware abstraction layer. Modules include this instead of the
+** avr-libc headers (<avr/io.h>, <avr/interrupt.h>, <avr/pgmspace.h>
+** and <avr/sleep.h>), so that they can also be built for a PC (see
+** host/hal_host.h and "make host").
+**
+** Both backends provide:
+** - the I/O registers by their usual names (PORTA, SPDR, TIMSK, SREG
+**   etc.) and their bit names
+** - cli(), sei(), ISR(vector) and the sleep functions
+** - PROGMEM, pgm_read_byte() and pgm_read_word()
+** - HAL_THREAD_LOCAL, the storage class of the game state (game.c
+**   and score.c). It is empty on the board; on the host each thread
+**   gets its own copy, so that several games can be played at once
+**   (see host/monte_carlo.c).
+**
+** Registers where writing has a side effect other than storing the
+** value must be written with the functions below, so that the host
+** backend can simulate it:
+**
+**		hal_spi_write(byte)			write SPDR (starts an SPI transfer)
+**		hal_clear_timer_flags(mask)	write TIFR (clears the flags that
+**									are 1 in the mask)
+**
+** The AVR backend (hal_avr.h) is just the avr-libc headers plus
+** static inline versions of these functions, each a single register
+** write, so they should compile to the same instructions as writing
+** the register directly. (This hasn't been checked by comparing the
+** disassembly.)
+*/
+
+#ifndef HAL_H
+#define HAL_H
+
+#ifdef HAL_HOST
+#include "host/hal_host.h"
+#else
+#include "hal_avr.h"
+#endif
+
+#endif
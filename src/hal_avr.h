@@ -0,0 +1,28 @@
+/*
+** hal_avr.h
+**
+** AVR backend of the hardware abstraction layer - see hal.h.
+*/
+
+#ifndef HAL_AVR_H
+#define HAL_AVR_H
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+
+#define HAL_THREAD_LOCAL
+
+static inline void hal_spi_write(uint8_t byte)
+{
+	SPDR = byte;
+}
+
+static inline void hal_clear_timer_flags(uint8_t mask)
+{
+	TIFR = mask;
+}
+
+#endif
@@ -0,0 +1,442 @@
+/*
+** hal_host.c
+**
+** Simulation of the ATmega64 registers, timers, SPI port and
+** interrupts for the host build - see hal_host.h.
+**
+** Time moves on from one event (a timer setting a flag or an SPI
+** transfer finishing) to the next, rather than a cycle at a time,
+** so a simulated second takes well under a millisecond.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "hal_host.h"
+
+/* Registers */
+volatile uint8_t PORTA, PORTB, PORTC, PORTD, PORTE, PORTF, PORTG;
+volatile uint8_t DDRA, DDRB, DDRC, DDRD, DDRE, DDRF, DDRG;
+volatile uint8_t PINA, PINB, PINC, PIND, PINE, PINF, PING;
+volatile uint8_t SREG;
+volatile uint8_t TIMSK, TIFR, ETIMSK, ETIFR;
+volatile uint8_t SPCR, SPSR, SPDR;
+volatile uint8_t TCCR0, TCNT0, OCR0;
+volatile uint8_t TCCR2, TCNT2, OCR2;
+volatile uint8_t TCCR1A, TCCR1B, TCCR3A, TCCR3B;
+volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+volatile uint16_t TCNT3, OCR3A, OCR3B, ICR3;
+
+#define NUM_TIMERS 4
+
+/* Flags a timer may set as it counts */
+#define MAX_TIMER_EVENTS 3
+
+/* A timer, as the registers currently set it up. The counter runs
+** from 0 to top and then back to 0; "events" are the counts at which
+** it sets a flag (top + 1 meaning when it goes back to 0).
+*/
+typedef struct {
+	uint16_t prescaler;		/* 0 if the timer is stopped */
+	uint16_t count;
+	uint16_t top;
+	uint8_t numEvents;
+	uint32_t eventCount[MAX_TIMER_EVENTS];
+	uint8_t eventFlag[MAX_TIMER_EVENTS];
+	volatile uint8_t* flags;
+	volatile uint8_t* enables;
+} Timer;
+
+/* Interrupt flag and enable bits for each vector (see hal_host.h) */
+typedef struct {
+	volatile uint8_t* flags;
+	uint8_t flag;
+	volatile uint8_t* enables;
+	uint8_t enable;
+} Vector;
+
+static const Vector vectors[HAL_HOST_NUM_VECTORS] = {
+	{ &TIFR, 1<<OCF2, &TIMSK, 1<<OCIE2 },
+	{ &TIFR, 1<<TOV2, &TIMSK, 1<<TOIE2 },
+	{ &TIFR, 1<<OCF1A, &TIMSK, 1<<OCIE1A },
+	{ &TIFR, 1<<OCF1B, &TIMSK, 1<<OCIE1B },
+	{ &TIFR, 1<<TOV1, &TIMSK, 1<<TOIE1 },
+	{ &TIFR, 1<<OCF0, &TIMSK, 1<<OCIE0 },
+	{ &TIFR, 1<<TOV0, &TIMSK, 1<<TOIE0 },
+	{ &SPSR, 1<<SPIF, &SPCR, 1<<SPIE },
+	{ &ETIFR, 1<<OCF3A, &ETIMSK, 1<<OCIE3A },
+	{ &ETIFR, 1<<TOV3, &ETIMSK, 1<<TOIE3 }
+};
+
+static void (*handlers[HAL_HOST_NUM_VECTORS])(void);
+
+/* Prescaler values for each clock select setting (0 = stopped or
+** an external clock, which isn't simulated)
+*/
+static const uint16_t timer0Prescalers[8] = {0, 1, 8, 32, 64, 128, 256, 1024};
+static const uint16_t timerPrescalers[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+
+/* Cycles counted by each timer's prescaler since its last count */
+static uint16_t prescalerCycles[NUM_TIMERS];
+
+static uint64_t cycles;
+
+/* SPI transfer in progress */
+static uint8_t spiBusy;
+static uint8_t spiByte;
+static uint64_t spiDoneCycle;
+static uint8_t (*spiDevice)(uint8_t);
+
+/* Set by hal_host_sei() if it ran an interrupt - see hal_host_sleep() */
+static uint8_t seiRanInterrupt;
+
+/* Private functions - only used within this module */
+static void load_timer(uint8_t number, Timer* timer);
+static void store_count(uint8_t number, uint16_t count);
+static uint32_t cycles_to_event(uint8_t number, Timer* timer,
+		uint8_t enabledOnly);
+static uint32_t cycles_to_next_event(uint8_t enabledOnly);
+static void advance(uint32_t n);
+static uint8_t run_interrupts(void);
+
+/* See comment in .h file */
+void hal_spi_write(uint8_t byte)
+{
+	static const uint8_t dividers[4] = {4, 16, 64, 128};
+	uint8_t divider = dividers[SPCR & 0x03];
+
+	if(spiBusy) {
+		SPSR |= (1<<WCOL);
+		return;
+	}
+	if(SPSR & (1<<SPI2X)) {
+		divider /= 2;
+	}
+	spiBusy = 1;
+	spiByte = byte;
+	spiDoneCycle = cycles + 8 * divider;
+}
+
+/* See comment in .h file */
+void hal_clear_timer_flags(uint8_t mask)
+{
+	TIFR &= ~mask;
+}
+
+/* See comment in .h file */
+void hal_host_register_isr(uint8_t vector, void (*handler)(void))
+{
+	handlers[vector] = handler;
+}
+
+/* See comment in .h file */
+void hal_host_sei(void)
+{
+	SREG |= (1<<SREG_I);
+	seiRanInterrupt = run_interrupts();
+}
+
+/* See comment in .h file */
+void hal_host_sleep(void)
+{
+	uint32_t n;
+
+	/* On the AVR the instruction after sei() is run before any
+	** pending interrupt, so an interrupt that was pending when
+	** "sei(); sleep_cpu();" ran wakes the CPU straight away.
+	*/
+	if(seiRanInterrupt) {
+		seiRanInterrupt = 0;
+		return;
+	}
+	while(1) {
+		n = cycles_to_next_event(1);
+		if(n == 0) {
+			fprintf(stderr, "hal_host: sleeping with no interrupt "
+					"to wake up\n");
+			exit(1);
+		}
+		advance(n);
+		if(run_interrupts()) {
+			return;
+		}
+	}
+}
+
+/* See comment in .h file */
+void hal_host_run_cycles(uint32_t n)
+{
+	uint32_t step;
+
+	while(n > 0) {
+		step = cycles_to_next_event(0);
+		if(step == 0 || step > n) {
+			step = n;
+		}
+		advance(step);
+		run_interrupts();
+		n -= step;
+	}
+}
+
+/* See comment in .h file */
+void hal_host_set_spi_device(uint8_t (*device)(uint8_t byte))
+{
+	spiDevice = device;
+}
+
+/* See comment in .h file */
+uint64_t hal_host_cycles(void)
+{
+	return cycles;
+}
+
+/****************** INTERNAL FUNCTIONS *********************/
+
+/* add_event()
+**  - adds a flag the timer sets when its counter reaches "count".
+*/
+static void add_event(Timer* timer, uint32_t count, uint8_t flag)
+{
+	timer->eventCount[timer->numEvents] = count;
+	timer->eventFlag[timer->numEvents] = flag;
+	timer->numEvents++;
+}
+
+/* load_timer()
+**  - works out from its registers how the given timer is counting.
+*/
+static void load_timer(uint8_t number, Timer* timer)
+{
+	uint8_t wgm;
+
+	timer->numEvents = 0;
+	switch(number) {
+	case 0:
+	case 2:
+		if(number == 0) {
+			timer->prescaler = timer0Prescalers[TCCR0 & 0x07];
+			timer->count = TCNT0;
+			timer->top = OCR0;
+			wgm = TCCR0 & ((1<<WGM01)|(1<<WGM00));
+		} else {
+			timer->prescaler = timerPrescalers[TCCR2 & 0x07];
+			timer->count = TCNT2;
+			timer->top = OCR2;
+			wgm = TCCR2 & ((1<<WGM21)|(1<<WGM20));
+		}
+		timer->flags = &TIFR;
+		timer->enables = &TIMSK;
+		/* The timer 2 flags are 6 bits above the timer 0 ones */
+		if(wgm == (1<<WGM01)) {
+			/* CTC - the compare flag is set as it goes back to 0 */
+			add_event(timer, timer->top + 1, (1<<OCF0) << (number * 3));
+		} else {
+			add_event(timer, timer->top, (1<<OCF0) << (number * 3));
+			timer->top = 0xFF;
+			add_event(timer, 0x100, (1<<TOV0) << (number * 3));
+		}
+		break;
+	case 1:
+		timer->prescaler = timerPrescalers[TCCR1B & 0x07];
+		timer->count = TCNT1;
+		wgm = ((TCCR1B >> WGM12) & 0x03) << 2 | (TCCR1A & 0x03);
+		timer->flags = &TIFR;
+		timer->enables = &TIMSK;
+		if(wgm == 4) {
+			timer->top = OCR1A;
+			add_event(timer, timer->top + 1UL, 1<<OCF1A);
+		} else {
+			timer->top = (wgm == 14) ? ICR1 : 0xFFFF;
+			add_event(timer, OCR1A, 1<<OCF1A);
+			add_event(timer, timer->top + 1UL, 1<<TOV1);
+		}
+		add_event(timer, OCR1B, 1<<OCF1B);
+		break;
+	default:
+		timer->prescaler = timerPrescalers[TCCR3B & 0x07];
+		timer->count = TCNT3;
+		wgm = ((TCCR3B >> WGM32) & 0x03) << 2 | (TCCR3A & 0x03);
+		timer->flags = &ETIFR;
+		timer->enables = &ETIMSK;
+		if(wgm == 4) {
+			timer->top = OCR3A;
+			add_event(timer, timer->top + 1UL, 1<<OCF3A);
+		} else {
+			timer->top = (wgm == 14) ? ICR3 : 0xFFFF;
+			add_event(timer, OCR3A, 1<<OCF3A);
+			add_event(timer, timer->top + 1UL, 1<<TOV3);
+		}
+		add_event(timer, OCR3B, 1<<OCF3B);
+		break;
+	}
+}
+
+static void store_count(uint8_t number, uint16_t count)
+{
+	switch(number) {
+	case 0:
+		TCNT0 = count;
+		break;
+	case 1:
+		TCNT1 = count;
+		break;
+	case 2:
+		TCNT2 = count;
+		break;
+	default:
+		TCNT3 = count;
+		break;
+	}
+}
+
+/* counts_to()
+**  - returns the number of counts until the timer's counter reaches
+**    the given event count, going back to 0 after top if need be.
+**    Returns 0 if it never does.
+*/
+static uint32_t counts_to(Timer* timer, uint32_t eventCount)
+{
+	uint32_t period = timer->top + 1UL;
+
+	if(eventCount > period) {
+		return 0;
+	}
+	if(eventCount > timer->count) {
+		return eventCount - timer->count;
+	}
+	return period - timer->count + eventCount;
+}
+
+/* cycles_to_event()
+**  - returns the number of CPU cycles until the timer next sets a
+**    flag (only flags with their interrupt enabled if enabledOnly is
+**    set), or 0 if it won't.
+*/
+static uint32_t cycles_to_event(uint8_t number, Timer* timer,
+		uint8_t enabledOnly)
+{
+	uint32_t best = 0;
+	uint32_t counts;
+	uint8_t i;
+
+	if(timer->prescaler == 0) {
+		return 0;
+	}
+	for(i=0; i < timer->numEvents; i++) {
+		if(enabledOnly && !(*timer->enables & timer->eventFlag[i])) {
+			continue;
+		}
+		counts = counts_to(timer, timer->eventCount[i]);
+		if(counts != 0 && (best == 0 || counts < best)) {
+			best = counts;
+		}
+	}
+	if(best == 0) {
+		return 0;
+	}
+	return best * timer->prescaler - prescalerCycles[number];
+}
+
+/* cycles_to_next_event()
+**  - returns the number of CPU cycles until the next flag is set by a
+**    timer or the SPI port (only those with their interrupts enabled
+**    if enabledOnly is set), or 0 if none will be.
+*/
+static uint32_t cycles_to_next_event(uint8_t enabledOnly)
+{
+	Timer timer;
+	uint32_t best = 0;
+	uint32_t n;
+	uint8_t i;
+
+	for(i=0; i < NUM_TIMERS; i++) {
+		load_timer(i, &timer);
+		n = cycles_to_event(i, &timer, enabledOnly);
+		if(n != 0 && (best == 0 || n < best)) {
+			best = n;
+		}
+	}
+	if(spiBusy && (!enabledOnly || (SPCR & (1<<SPIE)))) {
+		n = spiDoneCycle - cycles;
+		if(best == 0 || n < best) {
+			best = n;
+		}
+	}
+	return best;
+}
+
+/* advance()
+**  - moves the simulated clock on by n cycles, setting the flags of
+**    the events passed on the way.
+*/
+static void advance(uint32_t n)
+{
+	Timer timer;
+	uint32_t total;
+	uint32_t counts;
+	uint32_t period;
+	uint8_t i, j;
+
+	cycles += n;
+	for(i=0; i < NUM_TIMERS; i++) {
+		load_timer(i, &timer);
+		if(timer.prescaler == 0) {
+			continue;
+		}
+		total = prescalerCycles[i] + n;
+		counts = total / timer.prescaler;
+		prescalerCycles[i] = total % timer.prescaler;
+		if(counts == 0) {
+			continue;
+		}
+		for(j=0; j < timer.numEvents; j++) {
+			uint32_t to = counts_to(&timer, timer.eventCount[j]);
+			if(to != 0 && to <= counts) {
+				*timer.flags |= timer.eventFlag[j];
+			}
+		}
+		period = timer.top + 1UL;
+		store_count(i, (timer.count + counts) % period);
+	}
+
+	if(spiBusy && cycles >= spiDoneCycle) {
+		spiBusy = 0;
+		SPDR = spiDevice ? spiDevice(spiByte) : 0xFF;
+		SPSR |= (1<<SPIF);
+	}
+}
+
+/* run_interrupts()
+**  - runs the handlers for the interrupts that are pending (flag set)
+**    and enabled, highest priority first, if interrupts are enabled.
+**    As on the AVR, the flag is cleared and interrupts are disabled
+**    while each handler runs. Returns the number of handlers run.
+*/
+static uint8_t run_interrupts(void)
+{
+	uint8_t ran = 0;
+	uint8_t i;
+
+	while(SREG & (1<<SREG_I)) {
+		for(i=0; i < HAL_HOST_NUM_VECTORS; i++) {
+			if((*vectors[i].flags & vectors[i].flag) &&
+					(*vectors[i].enables & vectors[i].enable)) {
+				break;
+			}
+		}
+		if(i == HAL_HOST_NUM_VECTORS) {
+			break;
+		}
+		*vectors[i].flags &= ~vectors[i].flag;
+		if(!handlers[i]) {
+			fprintf(stderr, "hal_host: no handler for interrupt "
+					"vector %d\n", i);
+			exit(1);
+		}
+		SREG &= ~(1<<SREG_I);
+		handlers[i]();
+		SREG |= (1<<SREG_I);
+		ran++;
+	}
+	return ran;
+}
@@ -0,0 +1,231 @@
+/*
+** hal_host.h
+**
+** Host (PC) backend of the hardware abstraction layer - see hal.h.
+** Used when HAL_HOST is defined ("make host").
+**
+** The I/O registers are ordinary variables. hal_host.c simulates the
+** parts of the ATmega64 the game uses:
+** - timers 0 to 3 (normal and CTC modes, plus fast PWM mode 14 for
+**   the 16 bit timers), setting their flags as they count
+** - the SPI port (a byte written to SPDR is exchanged with the
+**   device given to hal_host_set_spi_device() after the time the
+**   transfer would take)
+** - interrupts, run in the AVR priority order when they are enabled
+**   (in TIMSK, ETIMSK or SPCR and by sei()) and their flag is set
+**
+** Code runs in no simulated time: the simulated clock only moves on
+** in sleep_cpu() (which waits until the next interrupt) or
+** hal_host_run_cycles(). That keeps the simulation deterministic and
+** lets it run as fast as the host can go. Code that busy-waits on a
+** register will therefore wait forever - the modules built for the
+** host sleep or use interrupts instead.
+*/
+
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+#include <stdint.h>
+
+/* I/O ports */
+extern volatile uint8_t PORTA, PORTB, PORTC, PORTD, PORTE, PORTF, PORTG;
+extern volatile uint8_t DDRA, DDRB, DDRC, DDRD, DDRE, DDRF, DDRG;
+extern volatile uint8_t PINA, PINB, PINC, PIND, PINE, PINF, PING;
+
+/* Status register, interrupt masks and flags */
+extern volatile uint8_t SREG;
+extern volatile uint8_t TIMSK, TIFR, ETIMSK, ETIFR;
+
+/* SPI */
+extern volatile uint8_t SPCR, SPSR, SPDR;
+
+/* 8 bit timers */
+extern volatile uint8_t TCCR0, TCNT0, OCR0;
+extern volatile uint8_t TCCR2, TCNT2, OCR2;
+
+/* 16 bit timers */
+extern volatile uint8_t TCCR1A, TCCR1B, TCCR3A, TCCR3B;
+extern volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+extern volatile uint16_t TCNT3, OCR3A, OCR3B, ICR3;
+
+/* SREG */
+#define SREG_I 7
+
+/* TIMSK and TIFR */
+#define OCIE2 7
+#define TOIE2 6
+#define TICIE1 5
+#define OCIE1A 4
+#define OCIE1B 3
+#define TOIE1 2
+#define OCIE0 1
+#define TOIE0 0
+#define OCF2 7
+#define TOV2 6
+#define ICF1 5
+#define OCF1A 4
+#define OCF1B 3
+#define TOV1 2
+#define OCF0 1
+#define TOV0 0
+
+/* ETIMSK and ETIFR */
+#define OCIE3A 4
+#define OCIE3B 3
+#define TOIE3 2
+#define OCF3A 4
+#define OCF3B 3
+#define TOV3 2
+
+/* TCCR0 and TCCR2 */
+#define WGM00 6
+#define COM01 5
+#define COM00 4
+#define WGM01 3
+#define CS02 2
+#define CS01 1
+#define CS00 0
+#define WGM20 6
+#define COM21 5
+#define COM20 4
+#define WGM21 3
+#define CS22 2
+#define CS21 1
+#define CS20 0
+
+/* TCCR1A/B and TCCR3A/B */
+#define COM1A1 7
+#define COM1A0 6
+#define COM1B1 5
+#define COM1B0 4
+#define WGM11 1
+#define WGM10 0
+#define WGM13 4
+#define WGM12 3
+#define CS12 2
+#define CS11 1
+#define CS10 0
+#define COM3A1 7
+#define COM3A0 6
+#define COM3B1 5
+#define COM3B0 4
+#define WGM31 1
+#define WGM30 0
+#define WGM33 4
+#define WGM32 3
+#define CS32 2
+#define CS31 1
+#define CS30 0
+
+/* SPCR and SPSR */
+#define SPIE 7
+#define SPE 6
+#define DORD 5
+#define MSTR 4
+#define CPOL 3
+#define CPHA 2
+#define SPR1 1
+#define SPR0 0
+#define SPIF 7
+#define WCOL 6
+#define SPI2X 0
+
+/* Port pins */
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PE0 0
+#define PE1 1
+#define PE2 2
+#define PE3 3
+#define PE4 4
+#define PE5 5
+#define PE6 6
+#define PE7 7
+
+#define _BV(bit) (1 << (bit))
+#define bit_is_set(reg, bit) ((reg) & _BV(bit))
+#define bit_is_clear(reg, bit) (!((reg) & _BV(bit)))
+
+/* Interrupt vectors simulated, in priority order (highest first) */
+enum {
+	TIMER2_COMP_vect_num,
+	TIMER2_OVF_vect_num,
+	TIMER1_COMPA_vect_num,
+	TIMER1_COMPB_vect_num,
+	TIMER1_OVF_vect_num,
+	TIMER0_COMP_vect_num,
+	TIMER0_OVF_vect_num,
+	SPI_STC_vect_num,
+	TIMER3_COMPA_vect_num,
+	TIMER3_OVF_vect_num,
+	HAL_HOST_NUM_VECTORS
+};
+
+/* ISR(vector) defines the handler and registers it (before main()
+** runs) with hal_host_register_isr().
+*/
+#define ISR(vector, ...) \
+	static void vector##_handler(void); \
+	static void __attribute__((constructor)) vector##_register(void) \
+	{ \
+		hal_host_register_isr(vector##_num, vector##_handler); \
+	} \
+	static void vector##_handler(void)
+#define ISR_NAKED
+
+#define cli() (SREG &= ~(1<<SREG_I))
+#define sei() hal_host_sei()
+
+/* Program memory is ordinary memory on the host */
+#define PROGMEM
+#define PGM_P const char*
+typedef uint8_t prog_uint8_t;
+#define pgm_read_byte(address) (*(address))
+#define pgm_read_word(address) (*(address))
+
+/* Sleeping waits (in simulated time) for the next interrupt */
+#define SLEEP_MODE_IDLE 0
+#define set_sleep_mode(mode)
+#define sleep_enable()
+#define sleep_disable()
+#define sleep_cpu() hal_host_sleep()
+
+/* See hal.h */
+#define HAL_THREAD_LOCAL __thread
+void hal_spi_write(uint8_t byte);
+void hal_clear_timer_flags(uint8_t mask);
+
+/* Simulator functions */
+
+/* Registers the handler for an interrupt vector (used by ISR()) */
+void hal_host_register_isr(uint8_t vector, void (*handler)(void));
+
+/* Sets the I bit in SREG and runs any interrupts that are pending */
+void hal_host_sei(void);
+
+/* Moves the simulated clock on until an interrupt has been run. Exits
+** the program if no enabled interrupt can ever occur.
+*/
+void hal_host_sleep(void);
+
+/* Moves the simulated clock on by the given number of CPU cycles,
+** running interrupts as they occur.
+*/
+void hal_host_run_cycles(uint32_t cycles);
+
+/* Sets the function called with each byte sent on the SPI port. It
+** returns the byte received in exchange. (With no device, 0xFF is
+** received.)
+*/
+void hal_host_set_spi_device(uint8_t (*device)(uint8_t byte));
+
+/* Returns the number of CPU cycles simulated so far */
+uint64_t hal_host_cycles(void);
+
+#endif
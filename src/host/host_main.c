@@ -0,0 +1,308 @@
+/*
+** host_main.c
+**
+** Headless simulation of the game, built for the host with "make
+** host" (see hal_host.h). The game logic (game.c and score.c), the
+** scrolling text (scrolling_char_display.c) and the timer 2 tick
+** tasks (display scan, seven segment display and sound effects) run
+** unchanged on top of the simulated hardware, with the joystick on
+** the simulated SPI port. The clock is simulated, so games run as
+** fast as the host can go.
+**
+** The joystick is moved and its fire button pressed at random (from
+** a seed, so runs can be repeated), or by the autopilot (see
+** autopilot.h). Each game runs until it is over or the time limit is
+** reached, after which "GAME OVER" is scrolled as on the board.
+**
+** Usage:
+**		simulate [-s seed] [-g games] [-t seconds] [-a] [-d]
+**
+** -s  seed of the first game (default 1 - game n uses seed + n)
+** -g  number of games (default 1)
+** -t  time limit for each game in simulated seconds (default 600)
+** -a  let the autopilot play (it moves the joystick at the start of
+**     each logic step, as it does on the board)
+** -d  draw the LED display (as text) each time the game field changes
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "../hal.h"
+#include "../game.h"
+#include "../score.h"
+#include "../led_display.h"
+#include "../scrolling_char_display.h"
+#include "../sseg_display.h"
+#include "../pmod.h"
+#include "../sfx.h"
+#include "../spi.h"
+#include "../joystick.h"
+#include "../timer2.h"
+#include "../autopilot.h"
+#include "../project.h"
+
+/* Globals that are defined in project.c on the board */
+uint16_t high_score = 0;
+uint8_t show_high_score = 0;
+uint8_t seven_seg_data[10] = {63,6,91,79,102,109,125,7,127,111};
+uint8_t seven_seg_cat = 0;
+uint16_t dropped_logic_steps = 0;
+
+/* Joystick update interval and the "GAME OVER" scroll interval (as in
+** project.c), and how often the simulated player changes what it is
+** doing (all in milliseconds)
+*/
+#define JOYSTICK_PERIOD_MS 4
+#define SCROLL_PERIOD_MS 150
+#define INPUT_PERIOD_MS 100
+
+/* Joystick position (-2 to 2) and buttons the simulated player is
+** holding, and the state of its random number generator
+*/
+static int8_t inputX;
+static uint8_t inputButtons;
+static uint16_t inputRandom;
+
+/* Bytes the simulated joystick sends back, and the next to send */
+static uint8_t joystickBytes[5];
+static uint8_t joystickIndex;
+
+static uint8_t gameIsOver;
+static uint8_t drawDisplay;
+static uint8_t autopilot;
+
+/* Private functions - only used within this module */
+static uint8_t joystick_device(uint8_t byte);
+static void choose_input(void);
+static void play_game(uint16_t seed, uint32_t limitMs);
+static void draw_display(void);
+
+/* Called by game.c (and on the board, project.c) when the base has no
+** health left.
+*/
+void gameOver(void)
+{
+	gameIsOver = 1;
+}
+
+int main(int argc, char** argv)
+{
+	uint16_t seed = 1;
+	uint16_t games = 1;
+	uint32_t limitMs = 600000;
+	uint32_t startTicks;
+	double simulated, wall;
+	struct timespec start, end;
+	uint16_t g;
+	int option;
+
+	while((option = getopt(argc, argv, "s:g:t:ad")) != -1) {
+		switch(option) {
+		case 's':
+			seed = atoi(optarg);
+			break;
+		case 'g':
+			games = atoi(optarg);
+			break;
+		case 't':
+			limitMs = atol(optarg) * 1000;
+			break;
+		case 'a':
+			autopilot = 1;
+			break;
+		case 'd':
+			drawDisplay = 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-s seed] [-g games] "
+					"[-t seconds] [-a] [-d]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	/* As initialise_hardware() in project.c, less the modules that
+	** aren't simulated
+	*/
+	init_display();
+	init_spi();
+	init_joystick();
+	hal_host_set_spi_device(joystick_device);
+	init_timer2();
+	init_sseg_score_display();
+	init_pmod();
+	init_sfx();
+	sei();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	startTicks = get_clock_ticks();
+	for(g=0; g < games; g++) {
+		play_game(seed + g, limitMs);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	simulated = (get_clock_ticks() - startTicks) / 1000.0;
+	wall = (end.tv_sec - start.tv_sec) +
+			(end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%.1f s simulated in %.3f s (%.0f times real time), "
+			"high score %u\n", simulated, wall,
+			wall > 0 ? simulated / wall : 0.0, high_score);
+	return 0;
+}
+
+/****************** INTERNAL FUNCTIONS *********************/
+
+/* joystick_device()
+**  - the Joystick PMOD on the simulated SPI port. A byte with bit 7
+**    set is the first of a transfer (see joystick_update()); the
+**    joystick replies with the X and Y positions (10 bits, low byte
+**    first) and the buttons.
+*/
+static uint8_t joystick_device(uint8_t byte)
+{
+	static const uint16_t positions[5] = {100, 300, 512, 700, 900};
+	uint16_t x = positions[inputX + 2];
+	uint16_t y = positions[2];
+
+	if(byte & 0x80) {
+		joystickBytes[0] = x & 0xFF;
+		joystickBytes[1] = x >> 8;
+		joystickBytes[2] = y & 0xFF;
+		joystickBytes[3] = y >> 8;
+		joystickBytes[4] = inputButtons;
+		joystickIndex = 0;
+	}
+	if(joystickIndex >= sizeof(joystickBytes)) {
+		return 0;
+	}
+	return joystickBytes[joystickIndex++];
+}
+
+/* choose_input()
+**  - the simulated player: every INPUT_PERIOD_MS it pushes the
+**    joystick left, right or not at all and presses or releases the
+**    fire button, at random.
+*/
+static void choose_input(void)
+{
+	static const int8_t moves[4] = {-2, 0, 0, 2};
+
+	/* xorshift - fine for this and the same on every host */
+	inputRandom ^= inputRandom << 7;
+	inputRandom ^= inputRandom >> 9;
+	inputRandom ^= inputRandom << 8;
+
+	inputX = moves[inputRandom & 0x03];
+	inputButtons = (inputRandom & 0x0C) ? 0x02 : 0x00;
+}
+
+/* play_game()
+**  - plays one game with the given seed (for both the asteroids and
+**    the player) and prints the result. The logic steps are run every
+**    LOGIC_TICK_MS as logic_step() in project.c does.
+*/
+static void play_game(uint16_t seed, uint32_t limitMs)
+{
+	uint32_t startTicks, now;
+	uint32_t joystickTime, logicTime, inputTime, nextTime;
+	uint32_t steps = 0;
+	uint8_t prevButtons = 0;
+	uint8_t buttons;
+	int8_t moveDirection;
+	uint8_t fire;
+
+	set_game_seed(seed);
+	inputRandom = seed ? seed : 1;
+	autopilot_reset(seed);
+	init_game_field();
+	init_score();
+	copy_game_field_to_led_display();
+	gameIsOver = 0;
+
+	startTicks = get_clock_ticks();
+	joystickTime = logicTime = inputTime = startTicks;
+	while(!gameIsOver && get_clock_ticks() - startTicks < limitMs) {
+		now = get_clock_ticks();
+		if(!autopilot && TIME_REACHED(now, inputTime)) {
+			choose_input();
+			inputTime += INPUT_PERIOD_MS;
+		}
+		if(TIME_REACHED(now, joystickTime)) {
+			joystick_update();
+			joystickTime += JOYSTICK_PERIOD_MS;
+		}
+		if(TIME_REACHED(now, logicTime)) {
+			if(autopilot) {
+				autopilot_choose(&inputX, &inputButtons);
+				joystick_override(inputX, 0, inputButtons);
+			}
+			moveDirection = MOVE_NONE;
+			if(joystickX < 0) {
+				moveDirection = MOVE_LEFT;
+			} else if(joystickX > 0) {
+				moveDirection = MOVE_RIGHT;
+			}
+			buttons = joystickButtons;
+			fire = BUTTON_1_PRESSED(buttons) &&
+					!BUTTON_1_PRESSED(prevButtons);
+			prevButtons = buttons;
+			steps++;
+			if(game_step(moveDirection, fire)) {
+				copy_game_field_to_led_display();
+				if(drawDisplay) {
+					draw_display();
+				}
+				if(getHealth() <= 0) {
+					gameOver();
+				} else {
+					outputHealth(getHealth());
+				}
+			}
+			logicTime += LOGIC_TICK_MS;
+		}
+
+		nextTime = logicTime;
+		if(TIME_REACHED(nextTime, joystickTime)) {
+			nextTime = joystickTime;
+		}
+		if(!autopilot && TIME_REACHED(nextTime, inputTime)) {
+			nextTime = inputTime;
+		}
+		sleep_until(nextTime);
+	}
+
+	printf("game %u: score %u, %s after %.1f s (%lu steps)\n", seed,
+			get_score(), gameIsOver ? "game over" : "time limit",
+			(get_clock_ticks() - startTicks) / 1000.0,
+			(unsigned long)steps);
+	if(get_score() > high_score) {
+		high_score = get_score();
+	}
+
+	/* Scroll the message until the display is blank */
+	set_display_text("GAME OVER");
+	nextTime = get_clock_ticks();
+	do {
+		nextTime += SCROLL_PERIOD_MS;
+		while(!deadline_reached(nextTime)) {
+			sleep_until(nextTime);
+		}
+	} while(scroll_display());
+}
+
+/* draw_display()
+**  - prints the LED display, "#" for each LED that is lit.
+*/
+static void draw_display(void)
+{
+	uint8_t row, column;
+
+	for(row=0; row < NUM_ROWS; row++) {
+		for(column=0; column < 15; column++) {
+			putchar((display[row] & (1 << column)) ? '#' : '.');
+		}
+		putchar('\n');
+	}
+	putchar('\n');
+}
@@ -0,0 +1,521 @@
+/*
+** monte_carlo.c
+**
+** Monte Carlo game simulator, built for the host with "make
+** montecarlo". Plays a large number of complete games with game.c
+** and score.c (just the game logic - no simulated hardware), spread
+** over all the CPU cores, and reports:
+**
+**		- how games ended and the distribution of scores
+**		- the distribution of game lengths
+**		- the time taken by game_step() (sampled)
+**		- games per second, in total and per core
+**
+** It is for trying out the game balance (build with e.g.
+** DEFS="-DMAX_ASTEROIDS=15 -DASTEROID_FALL_MIN_MS=800" - see game.h)
+** and for exercising game.c with many more games than can be played
+** by hand.
+**
+** Game n is played with seed (first seed + n). The seed sets both
+** game.c's random number generator (see set_game_seed()) and the
+** simulated player, so a game can be repeated on its own (or with
+** "simulate -s", on the board or with CMD_SET_STATE). game.c's seeds
+** are only 16 bits, so starting fields repeat every 65536 games; the
+** player's moves don't.
+**
+** The simulated player either mashes the joystick at random or, with
+** -a, is the autopilot (see autopilot.h) - which shows how long games
+** last with a player who keeps the field busy, and how the balance
+** holds up against one.
+**
+** Each thread plays its own games: the game state in game.c and
+** score.c is thread local (see HAL_THREAD_LOCAL in hal.h). Games are
+** shared out with work stealing - each thread starts with an equal
+** share, takes GAMES_PER_TAKE at a time from the front of it and,
+** when it runs out, takes half of what is left of another thread's
+** share from the back. Results are kept per thread and added up at
+** the end.
+**
+** Usage:
+**		montecarlo [-n games] [-j threads] [-s seed] [-t seconds] [-a]
+**
+** -n  number of games (default 1000000)
+** -j  number of threads (default: the number of CPU cores)
+** -s  seed of the first game (default 1)
+** -t  time limit for each game in game seconds (default 600)
+** -a  let the autopilot play instead of the random player
+*/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../game.h"
+#include "../score.h"
+#include "../led_display.h"
+#include "../sfx.h"
+#include "../joystick.h"
+#include "../autopilot.h"
+
+/* Games taken from a thread's share at a time */
+#define GAMES_PER_TAKE 64
+
+/* game_step() is timed every STEP_SAMPLE_INTERVAL steps (timing
+** every step would take longer than the step)
+*/
+#define STEP_SAMPLE_INTERVAL 64
+
+/* Scores above MAX_SCORE are counted together (a score that has gone
+** below 0 shows up as 65535 - see add_to_score())
+*/
+#define MAX_SCORE 1023
+
+/* Game lengths are counted in whole seconds */
+#define MAX_LENGTH_SECONDS 3600
+
+/* Step times are counted in powers of 2 nanoseconds: bucket n holds
+** times below 2^n ns
+*/
+#define NUM_STEP_BUCKETS 32
+
+/* Lines in the score histogram */
+#define HISTOGRAM_LINES 20
+
+/* Ways a game can end */
+enum {
+	END_GAME_OVER,
+	END_TIME_LIMIT,
+	NUM_ENDS
+};
+
+typedef struct {
+	uint64_t games;
+	uint64_t steps;
+	uint64_t ends[NUM_ENDS];
+	uint64_t scores[MAX_SCORE + 2];
+	uint64_t lengths[MAX_LENGTH_SECONDS + 1];
+	uint64_t stepTimes[NUM_STEP_BUCKETS];
+	uint64_t sampledSteps;
+	uint64_t sampledNanoseconds;
+	uint64_t maxStepNanoseconds;
+	uint64_t steals;
+} Stats;
+
+/* A thread and its share of the games: [next, end) are yet to be
+** taken. Changed only with the lock held.
+*/
+typedef struct {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	uint64_t next;
+	uint64_t end;
+	uint16_t index;
+	Stats stats;
+} Worker;
+
+/* Player's state for the current game (per thread) */
+typedef struct {
+	uint32_t random;
+	int8_t direction;
+	uint8_t button;
+	uint8_t prevButton;
+} Player;
+
+static Worker* workers;
+static uint16_t numWorkers;
+static uint16_t firstSeed = 1;
+static uint32_t stepLimit = 600 * (1000 / LOGIC_TICK_MS);
+static uint8_t autopilot;
+
+/* Set by gameOver() (per thread) */
+static __thread uint8_t gameIsOver;
+
+/* The LED display, written by copy_game_field_to_led_display() */
+volatile uint16_t display[NUM_ROWS];
+
+/* Private functions - only used within this module */
+static void* worker_thread(void* argument);
+static uint8_t take_games(Worker* worker, uint64_t* first,
+		uint64_t* count);
+static void play_game(uint64_t number, Stats* stats);
+static void choose_input(Player* player, uint32_t step, int8_t* direction,
+		uint8_t* fire);
+static uint64_t nanoseconds(void);
+static void add_stats(Stats* total, const Stats* stats);
+static void report(const Stats* total, double seconds);
+static uint32_t percentile(const uint64_t* counts, uint32_t size,
+		uint64_t total, uint8_t percent);
+
+/* Called by game.c when the base has no health left */
+void gameOver(void)
+{
+	gameIsOver = 1;
+}
+
+/* Outputs of game.c that aren't simulated */
+void outputHealth(int health)
+{
+}
+
+void sfx_trigger(uint8_t effect)
+{
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t games = 1000000;
+	uint64_t share;
+	uint64_t start;
+	Stats* total;
+	long cores;
+	int option;
+	uint16_t i;
+
+	cores = sysconf(_SC_NPROCESSORS_ONLN);
+	numWorkers = cores > 0 ? cores : 1;
+	while((option = getopt(argc, argv, "n:j:s:t:a")) != -1) {
+		switch(option) {
+		case 'n':
+			games = strtoull(optarg, 0, 10);
+			break;
+		case 'j':
+			numWorkers = atoi(optarg);
+			break;
+		case 's':
+			firstSeed = atoi(optarg);
+			break;
+		case 't':
+			stepLimit = atol(optarg) * (1000 / LOGIC_TICK_MS);
+			break;
+		case 'a':
+			autopilot = 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n games] [-j threads] "
+					"[-s seed] [-t seconds] [-a]\n", argv[0]);
+			return 1;
+		}
+	}
+	if(numWorkers == 0) {
+		numWorkers = 1;
+	}
+
+	/* Share the games out equally to start with */
+	workers = calloc(numWorkers, sizeof(Worker));
+	total = calloc(1, sizeof(Stats));
+	if(!workers || !total) {
+		fprintf(stderr, "montecarlo: out of memory\n");
+		return 1;
+	}
+	share = games / numWorkers;
+	for(i=0; i < numWorkers; i++) {
+		pthread_mutex_init(&workers[i].lock, 0);
+		workers[i].index = i;
+		workers[i].next = i * share;
+		workers[i].end = (i == numWorkers - 1) ? games : (i + 1) * share;
+	}
+
+	start = nanoseconds();
+	for(i=0; i < numWorkers; i++) {
+		pthread_create(&workers[i].thread, 0, worker_thread, &workers[i]);
+	}
+	for(i=0; i < numWorkers; i++) {
+		pthread_join(workers[i].thread, 0);
+		add_stats(total, &workers[i].stats);
+	}
+
+	report(total, (nanoseconds() - start) / 1e9);
+	return 0;
+}
+
+/****************** INTERNAL FUNCTIONS *********************/
+
+/* worker_thread()
+**  - plays games until there are none left to take.
+*/
+static void* worker_thread(void* argument)
+{
+	Worker* worker = argument;
+	uint64_t first, count;
+
+	while(take_games(worker, &first, &count)) {
+		while(count--) {
+			play_game(first++, &worker->stats);
+		}
+	}
+	return 0;
+}
+
+/* take_games()
+**  - takes up to GAMES_PER_TAKE games from the front of the worker's
+**    share, first stealing half of another worker's share if it has
+**    none left. Returns 0 if there are no games left anywhere.
+*/
+static uint8_t take_games(Worker* worker, uint64_t* first,
+		uint64_t* count)
+{
+	Worker* victim;
+	uint64_t stolen, stolenFirst = 0, remaining;
+	uint16_t i;
+
+	while(1) {
+		pthread_mutex_lock(&worker->lock);
+		remaining = worker->end - worker->next;
+		*count = remaining < GAMES_PER_TAKE ? remaining : GAMES_PER_TAKE;
+		*first = worker->next;
+		worker->next += *count;
+		pthread_mutex_unlock(&worker->lock);
+		if(*count) {
+			return 1;
+		}
+
+		/* Steal from the next worker that has games left */
+		stolen = 0;
+		for(i=1; i < numWorkers && !stolen; i++) {
+			victim = &workers[(worker->index + i) % numWorkers];
+			pthread_mutex_lock(&victim->lock);
+			remaining = victim->end - victim->next;
+			stolen = (remaining + 1) / 2;
+			victim->end -= stolen;
+			stolenFirst = victim->end;
+			pthread_mutex_unlock(&victim->lock);
+		}
+		if(!stolen) {
+			return 0;
+		}
+		pthread_mutex_lock(&worker->lock);
+		worker->next = stolenFirst;
+		worker->end = stolenFirst + stolen;
+		pthread_mutex_unlock(&worker->lock);
+		worker->stats.steals++;
+	}
+}
+
+/* play_game()
+**  - plays the given game until it is over or the step limit is
+**    reached, and adds the result to the statistics. The logic steps
+**    are run as logic_step() in project.c runs them.
+*/
+static void play_game(uint64_t number, Stats* stats)
+{
+	Player player;
+	uint32_t step;
+	uint32_t seconds;
+	uint64_t start, elapsed;
+	uint16_t score;
+	uint8_t bucket;
+	int8_t direction;
+	uint8_t fire;
+
+	set_game_seed(firstSeed + number);
+	memset(&player, 0, sizeof(player));
+	player.random = (uint32_t)(firstSeed + number) * 2654435761u + 1;
+	autopilot_reset(firstSeed + number);
+	init_game_field();
+	init_score();
+	gameIsOver = 0;
+
+	for(step=0; step < stepLimit && !gameIsOver; step++) {
+		choose_input(&player, step, &direction, &fire);
+		if(step % STEP_SAMPLE_INTERVAL == 0) {
+			start = nanoseconds();
+			game_step(direction, fire);
+			elapsed = nanoseconds() - start;
+			for(bucket=0; bucket < NUM_STEP_BUCKETS - 1 &&
+					(elapsed >> bucket) != 0; bucket++) {
+			}
+			stats->stepTimes[bucket]++;
+			stats->sampledSteps++;
+			stats->sampledNanoseconds += elapsed;
+			if(elapsed > stats->maxStepNanoseconds) {
+				stats->maxStepNanoseconds = elapsed;
+			}
+		} else {
+			game_step(direction, fire);
+		}
+		if(getHealth() <= 0) {
+			gameOver();
+		}
+	}
+
+	score = get_score();
+	seconds = step / (1000 / LOGIC_TICK_MS);
+	stats->games++;
+	stats->steps += step;
+	stats->ends[gameIsOver ? END_GAME_OVER : END_TIME_LIMIT]++;
+	stats->scores[score <= MAX_SCORE ? score : MAX_SCORE + 1]++;
+	stats->lengths[seconds <= MAX_LENGTH_SECONDS ?
+			seconds : MAX_LENGTH_SECONDS]++;
+}
+
+/* choose_input()
+**  - the simulated player: every 10 steps (100ms) it pushes the
+**    joystick left, right or not at all and presses or releases the
+**    fire button, at random - or, with -a, the autopilot decides
+**    every step. Fires when the button is first pressed, as the game
+**    does.
+*/
+static void choose_input(Player* player, uint32_t step, int8_t* direction,
+		uint8_t* fire)
+{
+	static const int8_t moves[4] = {MOVE_LEFT, MOVE_NONE, MOVE_NONE,
+			MOVE_RIGHT};
+	int8_t x;
+	uint8_t buttons;
+
+	if(autopilot) {
+		autopilot_choose(&x, &buttons);
+		player->direction = (x < 0) ? MOVE_LEFT :
+				(x > 0) ? MOVE_RIGHT : MOVE_NONE;
+		player->button = BUTTON_1_PRESSED(buttons) != 0;
+	} else if(step % 10 == 0) {
+		/* xorshift32 */
+		player->random ^= player->random << 13;
+		player->random ^= player->random >> 17;
+		player->random ^= player->random << 5;
+		player->direction = moves[player->random & 0x03];
+		player->button = (player->random & 0x0C) != 0;
+	}
+	*direction = player->direction;
+	*fire = player->button && !player->prevButton;
+	player->prevButton = player->button;
+}
+
+static uint64_t nanoseconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+static void add_stats(Stats* total, const Stats* stats)
+{
+	uint32_t i;
+
+	total->games += stats->games;
+	total->steps += stats->steps;
+	for(i=0; i < NUM_ENDS; i++) {
+		total->ends[i] += stats->ends[i];
+	}
+	for(i=0; i < MAX_SCORE + 2; i++) {
+		total->scores[i] += stats->scores[i];
+	}
+	for(i=0; i <= MAX_LENGTH_SECONDS; i++) {
+		total->lengths[i] += stats->lengths[i];
+	}
+	for(i=0; i < NUM_STEP_BUCKETS; i++) {
+		total->stepTimes[i] += stats->stepTimes[i];
+	}
+	total->sampledSteps += stats->sampledSteps;
+	total->sampledNanoseconds += stats->sampledNanoseconds;
+	if(stats->maxStepNanoseconds > total->maxStepNanoseconds) {
+		total->maxStepNanoseconds = stats->maxStepNanoseconds;
+	}
+	total->steals += stats->steals;
+}
+
+/* percentile()
+**  - returns the value (index into counts) below or at which the given
+**    percentage of the total count lies.
+*/
+static uint32_t percentile(const uint64_t* counts, uint32_t size,
+		uint64_t total, uint8_t percent)
+{
+	uint64_t rank = (total * percent + 99) / 100;
+	uint64_t sum = 0;
+	uint32_t i;
+
+	if(rank == 0) {
+		rank = 1;
+	}
+	for(i=0; i < size; i++) {
+		sum += counts[i];
+		if(sum >= rank) {
+			return i;
+		}
+	}
+	return size - 1;
+}
+
+static void report(const Stats* total, double seconds)
+{
+	uint64_t scoreSum = 0, counted, count;
+	uint32_t highest = 0, width, i, j;
+	uint32_t stepMedian, step99;
+
+	if(total->games == 0) {
+		printf("No games played\n");
+		return;
+	}
+
+	printf("%llu games, %u threads (%llu steals), %.1f s\n",
+			(unsigned long long)total->games, numWorkers,
+			(unsigned long long)total->steals, seconds);
+	printf("Ended: game over %.2f%%, time limit %.2f%%\n",
+			100.0 * total->ends[END_GAME_OVER] / total->games,
+			100.0 * total->ends[END_TIME_LIMIT] / total->games);
+
+	/* Scores */
+	for(i=0; i <= MAX_SCORE; i++) {
+		scoreSum += (uint64_t)i * total->scores[i];
+		if(total->scores[i]) {
+			highest = i;
+		}
+	}
+	counted = total->games - total->scores[MAX_SCORE + 1];
+	printf("\nScore: mean %.2f, median %u, 90%% %u, 99%% %u, max %u\n",
+			counted ? (double)scoreSum / counted : 0.0,
+			percentile(total->scores, MAX_SCORE + 2, total->games, 50),
+			percentile(total->scores, MAX_SCORE + 2, total->games, 90),
+			percentile(total->scores, MAX_SCORE + 2, total->games, 99),
+			highest);
+	width = highest / HISTOGRAM_LINES + 1;
+	for(i=0; i <= highest; i += width) {
+		count = 0;
+		for(j=i; j < i + width && j <= highest; j++) {
+			count += total->scores[j];
+		}
+		if(width == 1) {
+			printf("  %4u       %6.2f%%\n", i,
+					100.0 * count / total->games);
+		} else {
+			printf("  %4u-%-4u  %6.2f%%\n", i, i + width - 1,
+					100.0 * count / total->games);
+		}
+	}
+	if(total->scores[MAX_SCORE + 1]) {
+		printf("  over %u (or below 0): %.2f%%\n", MAX_SCORE,
+				100.0 * total->scores[MAX_SCORE + 1] / total->games);
+	}
+
+	/* Game lengths */
+	printf("\nLength (s): mean %.1f, median %u, 90%% %u, 99%% %u\n",
+			(double)total->steps / total->games / (1000 / LOGIC_TICK_MS),
+			percentile(total->lengths, MAX_LENGTH_SECONDS + 1,
+				total->games, 50),
+			percentile(total->lengths, MAX_LENGTH_SECONDS + 1,
+				total->games, 90),
+			percentile(total->lengths, MAX_LENGTH_SECONDS + 1,
+				total->games, 99));
+
+	/* Step times (the buckets are powers of 2, so these are upper
+	** bounds). The times include reading the clock, about 20ns.
+	*/
+	stepMedian = percentile(total->stepTimes, NUM_STEP_BUCKETS,
+			total->sampledSteps, 50);
+	step99 = percentile(total->stepTimes, NUM_STEP_BUCKETS,
+			total->sampledSteps, 99);
+	printf("\ngame_step() (1 in %u timed): mean %.0f ns, median <= %llu "
+			"ns, 99%% <= %llu ns, max %llu ns\n", STEP_SAMPLE_INTERVAL,
+			(double)total->sampledNanoseconds / total->sampledSteps,
+			1ULL << stepMedian, 1ULL << step99,
+			(unsigned long long)total->maxStepNanoseconds);
+
+	printf("\nThroughput: %.0f games/s, %.0f games/s per core, "
+			"%.1f M steps/s\n", total->games / seconds,
+			total->games / seconds / numWorkers,
+			total->steps / seconds / 1e6);
+}
@@ -0,0 +1,183 @@
+/*
+** input_latency.c
+**
+** Input to display latency measurement - see input_latency.h.
+**
+** The press being followed is described by the stage it last
+** reached (currentStage - NO_PRESS if none) and the time it reached
+** each stage. When it reaches INPUT_SCANNED the time for each stage
+** is stored in the next slot of the times arrays (replacing the
+** oldest press).
+*/
+
+#include "input_latency.h"
+#include "timer2.h"
+#include "atomic_section.h"
+
+#ifdef INPUT_LATENCY
+
+#define NO_PRESS 0xFF
+
+/* Time of the last joystick update */
+static uint32_t lastPollTime;
+
+/* The press being followed */
+static uint8_t currentStage = NO_PRESS;
+static uint8_t projectileRow;
+static uint32_t stageTimes[INPUT_SCANNED + 1];
+static uint32_t pollWindowStart;
+
+/* Times of the last INPUT_LATENCY_EVENTS presses. eventCount is the
+** number recorded since reset (it stops at 65535).
+*/
+static uint16_t times[NUM_INPUT_LATENCIES][INPUT_LATENCY_EVENTS];
+static uint8_t nextEvent;
+static uint16_t eventCount;
+
+/* Private functions - only used within this module */
+static void record_press(void);
+static uint16_t saturate(uint32_t micros);
+
+/* See comment in .h file */
+void input_latency_reset(void)
+{
+	ATOMIC_SECTION(ATOMIC_INPUT_LATENCY) {
+		currentStage = NO_PRESS;
+		nextEvent = 0;
+		eventCount = 0;
+	}
+}
+
+/* See comment in .h file */
+uint8_t input_latency_get(uint8_t stage, InputLatencyStats* stats)
+{
+	uint16_t sorted[INPUT_LATENCY_EVENTS];
+	uint16_t value;
+	uint8_t count;
+	uint8_t i, j;
+
+	if(stage >= NUM_INPUT_LATENCIES) {
+		return 0;
+	}
+	ATOMIC_SECTION(ATOMIC_INPUT_LATENCY) {
+		stats->count = eventCount;
+		for(i=0; i < INPUT_LATENCY_EVENTS; i++) {
+			sorted[i] = times[stage][i];
+		}
+	}
+	count = (stats->count < INPUT_LATENCY_EVENTS) ?
+			stats->count : INPUT_LATENCY_EVENTS;
+
+	/* Insertion sort - there are only a few values. (Until the
+	** array has been filled the values are in slots 0 to count-1.)
+	*/
+	for(i=1; i < count; i++) {
+		value = sorted[i];
+		for(j=i; j > 0 && sorted[j - 1] > value; j--) {
+			sorted[j] = sorted[j - 1];
+		}
+		sorted[j] = value;
+	}
+
+	if(count == 0) {
+		stats->median = 0;
+		stats->percentile90 = 0;
+		stats->percentile99 = 0;
+		stats->max = 0;
+		return 1;
+	}
+	/* Nearest rank percentiles: the smallest value with at least
+	** p% of the values less than or equal to it.
+	*/
+	stats->median = sorted[(50 * count + 99) / 100 - 1];
+	stats->percentile90 = sorted[(90 * count + 99) / 100 - 1];
+	stats->percentile99 = sorted[(99 * count + 99) / 100 - 1];
+	stats->max = sorted[count - 1];
+	return 1;
+}
+
+/* See comment in .h file */
+void input_latency_poll(uint8_t pressed)
+{
+	uint32_t now = get_clock_micros();
+
+	ATOMIC_SECTION(ATOMIC_INPUT_LATENCY) {
+		if(pressed) {
+			/* Start following this press (forgetting any other) */
+			pollWindowStart = lastPollTime;
+			stageTimes[INPUT_POLLED] = now;
+			currentStage = INPUT_POLLED;
+		}
+		lastPollTime = now;
+	}
+}
+
+/* See comment in .h file */
+void input_latency_mark(uint8_t stage, uint8_t row)
+{
+	uint32_t now;
+
+	/* Quick check first - this is called for every row scanned */
+	if(currentStage != stage - 1) {
+		return;
+	}
+	now = get_clock_micros();
+
+	ATOMIC_SECTION(ATOMIC_INPUT_LATENCY) {
+		/* (Check again - an interrupt handler may have started
+		** a new press.)
+		*/
+		if(currentStage != stage - 1) {
+			break;
+		}
+		if(stage == INPUT_FIRED) {
+			projectileRow = row;
+		} else if(stage == INPUT_SCANNED && row != projectileRow) {
+			/* Not the row we're waiting for */
+			break;
+		}
+		stageTimes[stage] = now;
+		currentStage = stage;
+		if(stage == INPUT_SCANNED) {
+			record_press();
+			currentStage = NO_PRESS;
+		}
+	}
+}
+
+/****************** INTERNAL FUNCTIONS *********************/
+
+/* record_press()
+**  - store the times of the stages of a press that has reached the
+**    display. Called with interrupts off.
+*/
+static void record_press(void)
+{
+	uint8_t stage;
+
+	times[INPUT_POLLED][nextEvent] =
+			saturate(stageTimes[INPUT_POLLED] - pollWindowStart);
+	for(stage = INPUT_STEP; stage <= INPUT_SCANNED; stage++) {
+		times[stage][nextEvent] =
+				saturate(stageTimes[stage] - stageTimes[stage - 1]);
+	}
+	times[INPUT_TOTAL][nextEvent] =
+			saturate(stageTimes[INPUT_SCANNED] - pollWindowStart);
+
+	if(++nextEvent == INPUT_LATENCY_EVENTS) {
+		nextEvent = 0;
+	}
+	if(eventCount != 0xFFFF) {
+		eventCount++;
+	}
+}
+
+/* saturate()
+**  - returns the given time, or 65535 if it is more than that.
+*/
+static uint16_t saturate(uint32_t micros)
+{
+	return (micros > 0xFFFF) ? 0xFFFF : micros;
+}
+
+#endif
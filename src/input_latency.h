@@ -0,0 +1,102 @@
+/*
+** input_latency.h
+**
+** Input to display latency measurement. Each press of the fire
+** button (joystick button 1) is followed through the program:
+**
+**		INPUT_POLLED	the joystick update that saw the press finished
+**		INPUT_STEP		a game logic step took the press
+**		INPUT_FIRED		fire_projectile() added the projectile
+**		INPUT_COPIED	the game field was copied to display[]
+**		INPUT_SCANNED	display_row() lit the row with the projectile
+**
+** and the time (in microseconds) taken by each stage is recorded.
+** The time for INPUT_POLLED is the time since the joystick update
+** before it - the press happened some time in that window, so it is
+** the longest the press could have waited to be polled. INPUT_TOTAL
+** is the sum of all the stages.
+**
+** Times for the last INPUT_LATENCY_EVENTS presses are kept, from
+** which input_latency_get() works out percentiles for each stage.
+** That shows whether the poll interval, the wait for the main loop
+** or the display scan is the stage to work on first.
+**
+** Only one press is followed at a time - a new press starts again.
+** A press that doesn't fire a projectile (e.g. because there are
+** already MAX_PROJECTILES in flight) is not recorded.
+**
+** Only compiled in if INPUT_LATENCY is defined. Otherwise the macros
+** and functions below compile to nothing.
+*/
+
+#ifndef INPUT_LATENCY_H
+#define INPUT_LATENCY_H
+
+#include <stdint.h>
+
+/* Stages (in order) */
+enum {
+	INPUT_POLLED,
+	INPUT_STEP,
+	INPUT_FIRED,
+	INPUT_COPIED,
+	INPUT_SCANNED,
+	INPUT_TOTAL,
+	NUM_INPUT_LATENCIES
+};
+
+/* Number of presses kept */
+#ifndef INPUT_LATENCY_EVENTS
+#define INPUT_LATENCY_EVENTS 32
+#endif
+
+/* Statistics for a stage (times in microseconds, up to 65535) */
+typedef struct {
+	uint16_t count;			/* presses recorded since reset */
+	uint16_t median;
+	uint16_t percentile90;
+	uint16_t percentile99;
+	uint16_t max;
+} InputLatencyStats;
+
+#ifdef INPUT_LATENCY
+
+/* init_input_latency() / input_latency_reset()
+** - forget all the presses recorded.
+*/
+void input_latency_reset(void);
+#define init_input_latency() input_latency_reset()
+
+/* input_latency_get()
+** - works out the statistics for the given stage over the last
+** INPUT_LATENCY_EVENTS presses (or fewer, if not that many have
+** been recorded). Returns 0 if the stage is not valid, 1 otherwise.
+** Takes a while - don't call from an interrupt handler.
+*/
+uint8_t input_latency_get(uint8_t stage, InputLatencyStats* stats);
+
+/* Used by the macros below */
+void input_latency_poll(uint8_t pressed);
+void input_latency_mark(uint8_t stage, uint8_t row);
+
+/* Called each time the joystick buttons are read. "pressed" is true
+** if the fire button has just been pressed.
+*/
+#define INPUT_LATENCY_POLL(pressed) input_latency_poll(pressed)
+
+/* Called when a press reaches the given stage. "row" is the display
+** row the projectile is on (for INPUT_FIRED), or the row being lit
+** (for INPUT_SCANNED). Ignored for the other stages.
+*/
+#define INPUT_LATENCY_MARK(stage, row) input_latency_mark(stage, row)
+
+#else
+
+#define init_input_latency()
+#define input_latency_reset()
+#define INPUT_LATENCY_POLL(pressed)
+#define INPUT_LATENCY_MARK(stage, row)
+
+#endif
+
+#endif
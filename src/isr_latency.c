@@ -0,0 +1,73 @@
+/*
+** isr_latency.c
+**
+** Interrupt latency measurement - see isr_latency.h.
+*/
+
+#include "hal.h"
+#include "isr_latency.h"
+#include "atomic_section.h"
+
+#ifdef ISR_LATENCY
+
+static IsrLatencyStats stats[NUM_LATENCY_SOURCES];
+
+/* See comment in .h file */
+uint8_t isr_latency_get(uint8_t source, IsrLatencyStats* result)
+{
+	if(source >= NUM_LATENCY_SOURCES) {
+		return 0;
+	}
+	ATOMIC_SECTION(ATOMIC_LATENCY_STATS) {
+		*result = stats[source];
+	}
+	return 1;
+}
+
+/* See comment in .h file */
+void isr_latency_reset(void)
+{
+	uint8_t i, j;
+
+	ATOMIC_SECTION(ATOMIC_LATENCY_STATS) {
+		for(i=0; i < NUM_LATENCY_SOURCES; i++) {
+			stats[i].minCycles = 0xFFFF;
+			stats[i].maxCycles = 0;
+			for(j=0; j < LATENCY_BUCKETS; j++) {
+				stats[i].histogram[j] = 0;
+			}
+		}
+	}
+}
+
+/* See comment in .h file */
+void isr_latency_record(uint8_t source, uint16_t cycles)
+{
+	IsrLatencyStats* s = &stats[source];
+	uint8_t bucket = 0;
+	uint16_t value = cycles;
+
+	if(cycles < s->minCycles) {
+		s->minCycles = cycles;
+	}
+	if(cycles > s->maxCycles) {
+		s->maxCycles = cycles;
+	}
+
+	/* Bucket is the number of bits needed for the latency. Deal
+	** with the high byte first to keep the loop short.
+	*/
+	if(value >= 0x100) {
+		bucket = 8;
+		value >>= 8;
+	}
+	while(value) {
+		bucket++;
+		value >>= 1;
+	}
+	if(s->histogram[bucket] != 0xFFFF) {
+		s->histogram[bucket]++;
+	}
+}
+
+#endif
@@ -0,0 +1,77 @@
+/*
+** isr_latency.h
+**
+** Interrupt latency measurement. For interrupts caused by a timer
+** reaching its compare (or TOP) value, the timer's count when the
+** interrupt handler starts tells us how long after the event the
+** handler ran. For each such interrupt the shortest and longest
+** latency (in CPU cycles) are recorded, along with a histogram of
+** latencies in powers of two. This shows whether a change has made
+** an interrupt (e.g. the 1ms tick) run too late.
+**
+** The latency includes the time to enter the interrupt and the
+** handler's register saving code (typically 20 to 40 cycles), as
+** well as any time spent waiting for another interrupt handler or a
+** section of code with interrupts off. The resolution is one count
+** of the timer - 64 cycles for the tick, 8 cycles for the SPI delay
+** timer and 1 cycle for timer 1.
+**
+** Only compiled in if ISR_LATENCY is defined. Otherwise the macro
+** and functions below compile to nothing.
+*/
+
+#ifndef ISR_LATENCY_H
+#define ISR_LATENCY_H
+
+#include <stdint.h>
+
+/* Interrupts measured */
+enum {
+	LATENCY_TICK,			/* TIMER2_COMP - see timer2.c */
+	LATENCY_SPI_DELAY,		/* TIMER0_COMP - see spi.c */
+	LATENCY_DDS_SAMPLE,		/* TIMER1_OVF - see dds.c */
+	LATENCY_SAMPLER,		/* TIMER1_COMPB - see sampler.c */
+	NUM_LATENCY_SOURCES
+};
+
+/* Number of histogram buckets. Bucket 0 counts latencies of 0
+** cycles; bucket n counts latencies from 2^(n-1) to 2^n - 1 cycles.
+*/
+#define LATENCY_BUCKETS 17
+
+typedef struct {
+	uint16_t minCycles;
+	uint16_t maxCycles;
+	uint16_t histogram[LATENCY_BUCKETS];
+} IsrLatencyStats;
+
+#ifdef ISR_LATENCY
+
+/* isr_latency_get()
+** - copies the statistics for the given interrupt into *stats.
+** Returns 0 if the source is not valid, 1 otherwise. Histogram
+** counts stop at 65535.
+*/
+uint8_t isr_latency_get(uint8_t source, IsrLatencyStats* stats);
+
+/* init_isr_latency() / isr_latency_reset()
+** - clear the statistics of all the interrupts.
+*/
+void isr_latency_reset(void);
+#define init_isr_latency() isr_latency_reset()
+
+/* Used by the macro below - must be called with interrupts off */
+void isr_latency_record(uint8_t source, uint16_t cycles);
+
+/* Record a latency. Used at the start of an interrupt handler. */
+#define ISR_LATENCY_RECORD(source, cycles) isr_latency_record(source, cycles)
+
+#else
+
+#define init_isr_latency()
+#define isr_latency_reset()
+#define ISR_LATENCY_RECORD(source, cycles)
+
+#endif
+
+#endif
@@ -3,11 +3,16 @@
 **
 ** Original version by Peter Sutton
 **
-** Implements SPI interface with the Joystick PMOD.
-** See the Joystick PMOD reference manual for details.
+** Implements SPI interface with the Joystick PMOD using the
+** shared SPI bus (see spi.h). See the Joystick PMOD reference
+** manual for details.
 */
 
-#include <avr/io.h>
+#include "hal.h"
+#include "joystick.h"
+#include "spi.h"
+#include "atomic_section.h"
+#include "input_latency.h"
 
 /* See description in .h file */
 volatile int8_t joystickX;
@@ -19,32 +24,44 @@ volatile uint8_t joystickButtons;
 */
 static uint8_t joystickLEDs = 0;
 
+/* True if the values reported are set by joystick_override() rather
+** than read from the joystick.
+*/
+static volatile uint8_t overridden = 0;
+
+/* SPI transaction used to communicate with the joystick, and the
+** bytes sent and received. The joystick uses the AVR SS line
+** (bit 0 of port B) as its chip select.
+*/
+static SpiTransaction joystickTransaction;
+static uint8_t txBytes[5];
+static uint8_t rxBytes[5];
+
 /* Private functions - only used within this module */
-static void delay_microsecond(void);
-static uint8_t transfer_byte(uint8_t);
+static void transfer_complete(SpiTransaction* transaction);
 
 /* See comment in .h file */
 void init_joystick(void)
 {
-	/* Set data direction register appropriately. The following
-	** bits are configured to be outputs:
-	** SS, MOSI, SCK (i.e. PB0, PB2, PB1)
-	*/
-	DDRB |= 0x07;
-
-	/* Take the slave select line high */
-	PORTB |= 0x01;
-
-	/* Setup SPI Control Register (SPCR) and SPSR
-	** We set as follows:
-	** - SPE bit = 1 (SPI Enable)
-	** - MSTR bit = 1 (Enable Master Mode)
-	** - CPOL and CPHA are 0 (SPI mode 0)
-	** - SPR1,SPR0 = 01 with SPI2X = 1 (in SPSR register)
-	**		 (Clock / 8, i.e. 1MHz)
+	/* Set up the transaction we use to talk to the joystick:
+	** - chip select is the SS line (bit 0 of port B) which init_spi()
+	**	 has already made an output
+	** - SPI mode 0 (CPOL and CPHA are 0)
+	** - Clock / 8, i.e. 1MHz
+	** - 5 bytes, with a 15 microsecond delay after SS goes low and
+	**	 between each byte (the Joystick PMOD reference manual asks
+	**	 for at least 15 and 10 microseconds respectively)
 	*/
-	SPCR = (1<<SPE)|(1<<MSTR)|(1<<SPR0);
-	SPSR  = (1<<SPI2X);
+	joystickTransaction.csPort = &PORTB;
+	joystickTransaction.csMask = 0x01;
+	joystickTransaction.mode = SPI_MODE0;
+	joystickTransaction.clock = SPI_CLOCK_DIV8;
+	joystickTransaction.txBuffer = txBytes;
+	joystickTransaction.rxBuffer = rxBytes;
+	joystickTransaction.length = 5;
+	joystickTransaction.byteDelay = 15;
+	joystickTransaction.callback = transfer_complete;
+	joystickTransaction.status = SPI_IDLE;
 
 	/* Initialise global variables */
 	joystickX = 0;
@@ -69,70 +86,73 @@ void set_joystick_leds(uint8_t led1, uint8_t led2)
 }
 
 /* See comment in .h file */
-void joystick_update(uint8_t led1, uint8_t led2)
+void joystick_update(void)
 {
-	uint8_t xLow, xHigh, yLow, yHigh;
-	uint8_t i;
-	uint8_t cmd;
-	uint16_t X, Y;
-
-	/* Take SS (slave select) line (bit 0 of port B) low
-	** to initiate communication.
-	*/
-	PORTB &= 0xFE;
-
-	/* Wait 15 microseconds - as per Joystick PMOD reference manual */
-	for(i=0; i<15; i++) {
-		delay_microsecond();
+	if(spi_pending(&joystickTransaction)) {
+		/* Previous update still in progress */
+		return;
 	}
 
 	/* Construct command word - see figure 3 in Joystick PMOD
-	** reference manual.
+	** reference manual. The remaining 4 bytes sent are 0.
 	*/
-	cmd = 0x80 | joystickLEDs;
-	
+	txBytes[0] = 0x80 | joystickLEDs;
 
-	/* Transfer each of the 5 bytes - as per the Joystick PMOD
-	** reference manual - with a 10microsecond delay between
-	** each byte.
-	*/
-	xLow = transfer_byte(cmd);
-
-	/* Wait for 10 microseconds */
-	for(i=0; i<10; i++) {
-		delay_microsecond();
-	}
+	spi_submit(&joystickTransaction);
+}
 
-	xHigh = transfer_byte(0);
+/* See comment in .h file */
+void joystick_override(int8_t x, int8_t y, uint8_t buttons)
+{
+	INPUT_LATENCY_POLL(BUTTON_1_PRESSED(buttons)
+			&& !BUTTON_1_PRESSED(joystickButtons));
 
-	/* Wait for 10 microseconds */
-	for(i=0; i<10; i++) {
-		delay_microsecond();
+	/* Interrupts are turned off so that an update that is just
+	** finishing can't overwrite some of the values.
+	*/
+	ATOMIC_SECTION(ATOMIC_JOYSTICK_OVERRIDE) {
+		overridden = 1;
+		joystickX = x;
+		joystickY = y;
+		joystickButtons = buttons;
 	}
+}
 
-	yLow = transfer_byte(0);
+/* See comment in .h file */
+void joystick_release(void)
+{
+	overridden = 0;
+}
 
-	/* Wait for 10 microseconds */
-	for(i=0; i<10; i++) {
-		delay_microsecond();
-	}
+/****************** INTERNAL FUNCTIONS *********************/
 
-	yHigh = transfer_byte(0);
+/* transfer_complete()
+**  - called from the SPI interrupt handler when all 5 bytes have
+**    been exchanged with the joystick. We decode the position and
+**    button values.
+*/
+static void transfer_complete(SpiTransaction* transaction)
+{
+	uint8_t xLow, xHigh, yLow, yHigh;
+	uint16_t X, Y;
 
-	/* Wait for 10 microseconds */
-	for(i=0; i<10; i++) {
-		delay_microsecond();
+	if(overridden) {
+		/* Keep the values given to joystick_override() */
+		return;
 	}
 
-	joystickButtons = transfer_byte(0);
-
-	/* Take slave select (SS) line high again */
-	PORTB |= 0x01;
+	xLow = rxBytes[0];
+	xHigh = rxBytes[1];
+	yLow = rxBytes[2];
+	yHigh = rxBytes[3];
+	INPUT_LATENCY_POLL(BUTTON_1_PRESSED(rxBytes[4])
+			&& !BUTTON_1_PRESSED(joystickButtons));
+	joystickButtons = rxBytes[4];
 
 	/* Reconstruct 16-bit X and Y valuess - these will be in the 
 	** range of 0 to 1023.
 	*/
-	X = (xHigh << 8) | yLow;
+	X = (xHigh << 8) | xLow;
 	Y = (yHigh << 8) | yLow;
 
 	/* Scale down our position to the range -2 to 2 */
@@ -160,39 +180,3 @@ void joystick_update(uint8_t led1, uint8_t led2)
 		joystickY = 2;
 	}
 }
-
-/****************** INTERNAL FUNCTIONS *********************/
-
-/* delay_microsecond()
-**  - when used as part of loop, this function will take
-**    1 microsecond of execution time (when including the 
-**    loop overhead, and the procedure call and return overhead.
-**	  (We assume execution on ATmega64 with 8MHz clock.)
-*/
-static void delay_microsecond(void) {
-	/* We use inline assembly language */
-	asm("nop\r\n" "nop\r\n" "nop\r\n" "nop\r\n"::);
-}
-
-/* transfer_byte()
-**  - write out a byte to the SPI data register and wait until
-**    communication is complete, and then return the byte
-**    that was shifted in.
-*/
-static uint8_t transfer_byte(uint8_t byte)
-{
-	/* Write out byte to SPDR register. This will initiate
-	** the transfer. We then wait until the most significant
-	** bit of SPSR (SPIF bit) is set - this indicates that
-	** the transfer is complete. (The final read of SPSR
-	** (after the MSB is 1) followed by a read of SPDR will
-	** cause the SPIF bit to be reset to 0. See page 169
-	** of the ATmega64 datasheet.)
-	*/
-	SPDR = byte;
-	while((SPSR & 0x80) == 0) {
-		;
-	}
-	return SPDR;
-}
-
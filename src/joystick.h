@@ -2,7 +2,8 @@
 ** joystick.h
 **
 ** Global variables and functions for interacting with a Joystick PMOD
-** connected to the AVR SPI port - lower few bits of port B.
+** connected to the AVR SPI port - lower few bits of port B. The SPI
+** port is shared with other devices - see spi.h.
 */
 
 #ifndef JOYSTICK_H
@@ -30,8 +31,8 @@ extern volatile uint8_t joystickButtons;
 #define BUTTON_2_PRESSED(buttons) ((buttons) & 0x04)
 
 /* init_joystick()
-** - must be called before the joystick is used. Sets up the SPI control
-** registers appropriate and the data direction registers
+** - must be called before the joystick is used (and after init_spi()).
+** Sets up the SPI transaction used to talk to the joystick.
 */
 void init_joystick(void);
 
@@ -42,11 +43,26 @@ void init_joystick(void);
 void set_joystick_leds(uint8_t led1, uint8_t led2);
 
 /* joystick_update()
-** - gets the current joystick position and button status (global variables
-** above will be updated), and update LEDs on the joystick. Note that this 
-** function does not return until communication with the joystick is complete. 
-** This can take over 140 microseconds.
+** - starts communication with the joystick to get the current joystick
+** position and button status, and update LEDs on the joystick. This
+** function returns immediately - the global variables above are updated
+** (from the SPI interrupt handler) when communication is complete, which
+** takes about 130 microseconds. If the previous update is still in
+** progress, this function does nothing.
 */
 void joystick_update(void);
 
+/* joystick_override()
+** - from now on, ignore the real joystick and report the given
+** position and buttons instead (e.g. for automated tests - see
+** command.h). The joystick LEDs are still updated.
+*/
+void joystick_override(int8_t x, int8_t y, uint8_t buttons);
+
+/* joystick_release()
+** - go back to reporting the real joystick position and buttons
+** (from the next update).
+*/
+void joystick_release(void);
+
 #endif
@@ -13,7 +13,8 @@
 */
 
 #include "led_display.h"
-#include <avr/io.h>
+#include "input_latency.h"
+#include "hal.h"
 
 /* Global variable - see comment in header file */
 volatile uint16_t display[NUM_ROWS];
@@ -60,4 +61,9 @@ void display_row(void) {
 	 */
 	PORTA = ~(uint8_t)(display[row] & 0xFF);
 	PORTC = ~(uint8_t)((display[row] >> 8)& 0X7F);
+
+	/* If we're waiting for a newly fired projectile to be shown,
+	** this may be its row
+	*/
+	INPUT_LATENCY_MARK(INPUT_SCANNED, row);
 }
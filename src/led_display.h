@@ -6,7 +6,7 @@
 **
 */
 
-#include <avr/io.h>
+#include "hal.h"
 
 /* Number of rows in our display */
 #define NUM_ROWS 7
@@ -33,5 +33,6 @@ void init_display(void);
 void display_row(void);
 	/* Display the next row of data. Should be called every 
 	 * millisecond or two to ensure that there is no perceptible
-	 * display flicker.
+	 * display flicker. This is called every 2ms from the timer 2
+	 * interrupt handler (see timer2.c).
 	 */
@@ -0,0 +1,197 @@
+/*
+** persist.c
+**
+** EEPROM storage - see persist.h.
+**
+** A record is a sequence number, the data and a CRC (over the
+** sequence number and the data). The sequence number goes up by one
+** for each save and wraps around; since only the last PERSIST_SLOTS
+** saves are in EEPROM, the newest record is the one whose sequence
+** number is "after" all the others (see init_persist()).
+**
+** Saves waiting to be written are held in a small queue. The EEPROM
+** ready interrupt is enabled while the queue is not empty; each time
+** it fires (i.e. the EEPROM is ready for another write) we write the
+** next byte. Bytes that already hold the right value are skipped,
+** which saves both time and wear.
+*/
+
+#include "hal.h"
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include "persist.h"
+#include "atomic_section.h"
+
+typedef struct {
+	uint8_t sequence;
+	PersistData data;
+	uint8_t crc;
+} Record;
+
+#define RECORD_SIZE sizeof(Record)
+
+/* A queued save - the record and the slot it is to be written to */
+typedef struct {
+	Record record;
+	uint8_t slot;
+} QueuedSave;
+
+/* Queue of saves to be written. queueHead is the save being
+** written; writeIndex is the next byte of it to be written.
+*/
+static QueuedSave queue[PERSIST_QUEUE_SIZE];
+static volatile uint8_t queueHead;
+static volatile uint8_t queueCount;
+static uint8_t writeIndex;
+
+/* The latest data, its sequence number and the slot the next save
+** goes in.
+*/
+static PersistData currentData;
+static uint8_t foundData;
+static uint8_t lastSequence;
+static uint8_t nextSlot;
+
+/* Private functions - only used within this module */
+static uint8_t record_crc(const Record* record);
+
+/* See comment in .h file */
+void init_persist(void)
+{
+	Record record;
+	uint8_t slot;
+	uint8_t i;
+
+	queueHead = 0;
+	queueCount = 0;
+	writeIndex = 0;
+	foundData = 0;
+	lastSequence = 0;
+	nextSlot = 0;
+
+	/* Look at every slot and keep the newest valid record. The
+	** sequence numbers of the valid records are all within
+	** PERSIST_SLOTS of each other, so comparing them as signed
+	** differences works even when they have wrapped around.
+	*/
+	for(slot = 0; slot < PERSIST_SLOTS; slot++) {
+		eeprom_read_block(&record,
+				(const void*)(PERSIST_BASE + slot * RECORD_SIZE),
+				RECORD_SIZE);
+		if(record.crc != record_crc(&record)) {
+			continue;
+		}
+		if(!foundData || (int8_t)(record.sequence - lastSequence) > 0) {
+			foundData = 1;
+			lastSequence = record.sequence;
+			currentData = record.data;
+			nextSlot = (slot + 1) % PERSIST_SLOTS;
+		}
+	}
+
+	if(!foundData) {
+		currentData.highScore = 0;
+		for(i = 0; i < sizeof(currentData.settings); i++) {
+			currentData.settings[i] = 0xFF;
+		}
+	}
+}
+
+/* See comment in .h file */
+uint8_t persist_load(PersistData* data)
+{
+	*data = currentData;
+	return foundData;
+}
+
+/* See comment in .h file */
+void persist_save(const PersistData* data)
+{
+	QueuedSave* save;
+
+	currentData = *data;
+	foundData = 1;
+
+	ATOMIC_SECTION(ATOMIC_PERSIST_SAVE) {
+		if(queueCount == PERSIST_QUEUE_SIZE) {
+			/* Queue full - replace the newest waiting save (which
+			** can't be the one being written). It keeps its sequence
+			** number and slot.
+			*/
+			save = &queue[(queueHead + queueCount - 1) % PERSIST_QUEUE_SIZE];
+		} else {
+			save = &queue[(queueHead + queueCount) % PERSIST_QUEUE_SIZE];
+			save->record.sequence = ++lastSequence;
+			save->slot = nextSlot;
+			nextSlot = (nextSlot + 1) % PERSIST_SLOTS;
+			queueCount++;
+		}
+		save->record.data = *data;
+		save->record.crc = record_crc(&save->record);
+
+		/* Start (or keep) the EEPROM ready interrupt going */
+		EECR |= (1<<EERIE);
+	}
+}
+
+/* See comment in .h file */
+uint8_t persist_busy(void)
+{
+	return queueCount != 0;
+}
+
+/* EEPROM ready interrupt - the last write (if any) is complete.
+** Write the next byte of the save at the head of the queue.
+*/
+ISR(EE_READY_vect)
+{
+	QueuedSave* save;
+	uint8_t data;
+
+	if(queueCount == 0) {
+		/* Nothing more to write */
+		EECR &= ~(1<<EERIE);
+		return;
+	}
+	save = &queue[queueHead];
+	data = ((const uint8_t*)&save->record)[writeIndex];
+	EEAR = PERSIST_BASE + save->slot * RECORD_SIZE + writeIndex;
+
+	if(++writeIndex == RECORD_SIZE) {
+		/* This save is complete once this byte is written */
+		writeIndex = 0;
+		queueHead = (queueHead + 1) % PERSIST_QUEUE_SIZE;
+		queueCount--;
+	}
+
+	/* Read the byte first and only write it if it is different.
+	** (If it's the same, this interrupt fires again straight away
+	** for the next byte.) EEWE must be set within four cycles of
+	** EEMWE - interrupts are already off here.
+	*/
+	EECR |= (1<<EERE);
+	if(EEDR != data) {
+		EEDR = data;
+		EECR |= (1<<EEMWE);
+		EECR |= (1<<EEWE);
+	}
+}
+
+/****************** INTERNAL FUNCTIONS *********************/
+
+/* record_crc()
+**  - returns the CRC of the sequence number and data of a record.
+**    (The CRC of an erased record - all 0xFF - is not 0xFF, so
+**    erased slots are never taken to be valid.)
+*/
+static uint8_t record_crc(const Record* record)
+{
+	const uint8_t* bytes = (const uint8_t*)record;
+	uint8_t crc = 0;
+	uint8_t i;
+
+	for(i = 0; i < RECORD_SIZE - 1; i++) {
+		crc = _crc_ibutton_update(crc, bytes[i]);
+	}
+	return crc;
+}
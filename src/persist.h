@@ -0,0 +1,69 @@
+/*
+** persist.h
+**
+** Non-volatile storage for the high score and game settings, kept
+** in EEPROM so that they survive a reset.
+**
+** Writing a byte of EEPROM takes about 3.3ms, so saves are done in
+** the background: persist_save() queues the data and returns, and
+** the bytes are written one at a time from the EEPROM ready
+** interrupt. The display keeps running while this happens.
+**
+** To spread the wear on the EEPROM, each save is written to the
+** next of PERSIST_SLOTS record slots in turn. Each record holds a
+** sequence number and a CRC, so at start up the newest complete
+** record can be found (a record that was only partly written when
+** the power went off fails its CRC check and is ignored).
+*/
+
+#ifndef PERSIST_H
+#define PERSIST_H
+
+#include <stdint.h>
+
+/* EEPROM address of the first record slot and the number of slots.
+** Each record takes 8 bytes.
+*/
+#define PERSIST_BASE 0
+#define PERSIST_SLOTS 32
+
+/* Number of saves that can be waiting to be written (including the
+** one being written). If the queue is full, the newest waiting save
+** is replaced - only the latest data matters.
+*/
+#define PERSIST_QUEUE_SIZE 2
+
+/* The data that is saved. settings[] is available for game
+** settings; its bytes are 0xFF if nothing has been saved.
+*/
+typedef struct {
+	uint16_t highScore;
+	uint8_t settings[4];
+} PersistData;
+
+/* init_persist()
+** - finds the newest valid record in EEPROM. Must be called before
+** the other functions below (and before interrupts are enabled).
+*/
+void init_persist(void);
+
+/* persist_load()
+** - copies the most recently saved data (or, if nothing has been
+** saved, a high score of 0 and settings of 0xFF) into *data.
+** Returns 1 if saved data was found, 0 otherwise.
+*/
+uint8_t persist_load(PersistData* data);
+
+/* persist_save()
+** - queue the given data to be saved. Returns straight away - the
+** data is written in the background. Never fails; a save that is
+** still waiting may be replaced by this one.
+*/
+void persist_save(const PersistData* data);
+
+/* persist_busy()
+** - returns 1 if saved data is still being written to EEPROM.
+*/
+uint8_t persist_busy(void);
+
+#endif
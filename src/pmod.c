@@ -1,6 +1,6 @@
 #include "game.h"
 #include <stdlib.h>
-#include <avr/interrupt.h>
+#include "hal.h"
 
 /* Inititalise PMOD on JH
 **		- Reset Button on Pin7 on DDRD (Maps to Button 0 on PMOD)
@@ -28,25 +28,31 @@ void init_pmod(void) {
 }
 
 void outputHealth(int health) {
+	/* The health LEDs are on the upper 4 bits of port E. We leave
+	** the lower 4 bits alone (PE3 is the speaker output).
+	*/
+	uint8_t leds = PORTE & 0xF0;
+
 	switch (health) {
 		case 0:
-			PORTE = 0x00;
+			leds = 0x00;
 			break;
 		
 		case 1:
-			PORTE = (0xF0>>3);
+			leds = (0xF0>>3);
 			break;
 			
 		case 2:
-			PORTE = (0xF0>>2);
+			leds = (0xF0>>2);
 			break;
 			
 		case 3:
-			PORTE = (0xF0>>1) ;
+			leds = (0xF0>>1) ;
 			break;
 			
 		case 4:
-			PORTE = 0xF0;
+			leds = 0xF0;
 			break;
 	}
+	PORTE = (PORTE & 0x0F) | (leds & 0xF0);
 }
@@ -0,0 +1,117 @@
+/*
+** profile.c
+**
+** Cycle counting probes - see profile.h.
+**
+** Timer 1 runs in normal mode with no prescaling, so TCNT1 counts
+** CPU cycles (wrapping every 65536). A probe reads the count at the
+** start and end and records the difference. The time taken by an
+** empty BEGIN/END pair is measured at start up and subtracted.
+*/
+
+#include "hal.h"
+#include "profile.h"
+#include "atomic_section.h"
+
+#ifdef PROFILE
+
+#ifdef SFX_DDS
+#error "PROFILE and SFX_DDS can't be used together - both need timer 1"
+#endif
+
+static ProfileStats stats[NUM_PROFILE_PROBES];
+
+/* Cycles taken by the probes themselves */
+static uint16_t overhead;
+
+/* See comment in .h file */
+void init_profile(void)
+{
+	uint16_t start;
+
+	/* Normal mode, clock source is the CPU clock */
+	TCCR1A = 0;
+	TCCR1B = (1<<CS10);
+
+	/* Measure an empty probe (using the first probe's statistics,
+	** which are then cleared).
+	*/
+	overhead = 0;
+	profile_reset();
+	start = profile_now();
+	profile_record(0, start);
+	overhead = stats[0].maxCycles;
+	profile_reset();
+}
+
+/* See comment in .h file */
+uint8_t profile_get(uint8_t id, ProfileStats* result)
+{
+	if(id >= NUM_PROFILE_PROBES) {
+		return 0;
+	}
+	ATOMIC_SECTION(ATOMIC_PROFILE_STATS) {
+		*result = stats[id];
+	}
+	return 1;
+}
+
+/* See comment in .h file */
+void profile_reset(void)
+{
+	uint8_t i;
+
+	ATOMIC_SECTION(ATOMIC_PROFILE_STATS) {
+		for(i=0; i < NUM_PROFILE_PROBES; i++) {
+			stats[i].count = 0;
+			stats[i].totalCycles = 0;
+			stats[i].minCycles = 0xFFFF;
+			stats[i].maxCycles = 0;
+		}
+	}
+}
+
+/* Returns the current cycle count. Interrupts are turned off while
+** we read TCNT1, since reading a 16 bit timer register uses the
+** timer's TEMP register, which an interrupt handler may also use.
+** (This and profile_record() turn interrupts off by hand rather than
+** with ATOMIC_SECTION(), which would read the timer as well when
+** ATOMIC_TRACE is on and so add to the time of every probe.)
+*/
+uint16_t profile_now(void)
+{
+	uint16_t now;
+
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	cli();
+	now = TCNT1;
+	if(interruptsOn) {
+		sei();
+	}
+	return now;
+}
+
+/* Record the time since startTime for the given probe */
+void profile_record(uint8_t id, uint16_t startTime)
+{
+	ProfileStats* probe = &stats[id];
+	uint16_t cycles;
+
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	cli();
+	cycles = TCNT1 - startTime;
+	cycles = (cycles > overhead) ? cycles - overhead : 0;
+	probe->count++;
+	probe->totalCycles += cycles;
+	if(cycles < probe->minCycles) {
+		probe->minCycles = cycles;
+	}
+	if(cycles > probe->maxCycles) {
+		probe->maxCycles = cycles;
+	}
+	if(interruptsOn) {
+		sei();
+	}
+}
+
+#endif
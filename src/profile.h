@@ -0,0 +1,83 @@
+/*
+** profile.h
+**
+** Cycle counting probes for measuring how long pieces of code take.
+** Put PROFILE_BEGIN(id) at the start of the code to be measured and
+** PROFILE_END(id) at the end (in the same block), where id is one of
+** the probe IDs below. For each probe the number of times it ran and
+** the total, shortest and longest times (in CPU cycles) are kept.
+**
+** Probes can be used in interrupt handlers as well as the main
+** program. If a probe's code is interrupted, the time taken by the
+** interrupt handler is included.
+**
+** Profiling is only compiled in if PROFILE is defined (e.g. with
+** -DPROFILE). Otherwise the macros and functions below compile to
+** nothing. When enabled, timer 1 is used as a free running cycle
+** counter, so profiling can't be used with the DDS synthesiser.
+** Times of more than 65535 cycles (about 8ms) can't be measured.
+*/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+/* Probe IDs */
+enum {
+	PROF_LOGIC_STEP,
+	PROF_ADVANCE_PROJECTILES,
+	PROF_ADVANCE_ASTEROIDS,
+	PROF_COPY_FIELD,
+	PROF_JOYSTICK_UPDATE,
+	PROF_SCROLL_DISPLAY,
+	PROF_TICK_ISR,
+	PROF_SPI_ISR,
+	NUM_PROFILE_PROBES
+};
+
+/* Statistics for a probe (times are in CPU cycles, with the time
+** taken by the probe itself removed).
+*/
+typedef struct {
+	uint32_t count;
+	uint32_t totalCycles;
+	uint16_t minCycles;
+	uint16_t maxCycles;
+} ProfileStats;
+
+#ifdef PROFILE
+
+/* init_profile()
+** - starts timer 1 counting CPU cycles and clears the statistics.
+*/
+void init_profile(void);
+
+/* profile_get()
+** - copies the statistics for the given probe into *stats. Returns
+** 0 if the probe ID is not valid, 1 otherwise.
+*/
+uint8_t profile_get(uint8_t id, ProfileStats* stats);
+
+/* profile_reset()
+** - clears the statistics of all probes.
+*/
+void profile_reset(void);
+
+/* Used by the macros below */
+uint16_t profile_now(void);
+void profile_record(uint8_t id, uint16_t startTime);
+
+#define PROFILE_BEGIN(id) uint16_t profileStart_##id = profile_now()
+#define PROFILE_END(id) profile_record(id, profileStart_##id)
+
+#else
+
+#define init_profile()
+#define profile_reset()
+#define PROFILE_BEGIN(id)
+#define PROFILE_END(id)
+
+#endif
+
+#endif
@@ -4,18 +4,33 @@
 ** Original version by Peter Sutton
 */
 
-#include <avr/io.h>
-#include <avr/interrupt.h>
+#include "hal.h"
 #define _CSSE1000_MAIN
 #include "game.h"
 #include "joystick.h"
+#include "spi.h"
 #include "led_display.h"
 #include "score.h"
 #include "timer2.h"
+#include "scheduler.h"
 #include "scrolling_char_display.h"
 #include "sseg_display.h"
 #include "pmod.h"
 #include "sfx.h"
+#include "persist.h"
+#include "profile.h"
+#include "sampler.h"
+#include "isr_latency.h"
+#include "atomic_section.h"
+#include "stack_monitor.h"
+#include "watchdog.h"
+#include "uart.h"
+#include "telemetry.h"
+#include "display_mirror.h"
+#include "command.h"
+#include "input_latency.h"
+#include "trace.h"
+#include "autopilot.h"
 
 
 
@@ -26,9 +41,81 @@ uint8_t show_high_score = 0;
 
 uint8_t seven_seg_data[10] = {63,6,91,79,102,109,125,7,127,111};
 uint8_t seven_seg_cat = 0; 
-int lapse=0;
 char direction='L';
 
+/* Number of logic steps skipped because the game logic fell too
+** far behind real time (see logic_task()).
+*/
+uint16_t dropped_logic_steps = 0;
+
+/* Number of game milliseconds simulated for each real millisecond.
+** Test builds can define this as more than 1 to run the game logic
+** faster than real time.
+*/
+#ifndef LOGIC_SPEEDUP
+#define LOGIC_SPEEDUP 1
+#endif
+
+/* Maximum number of logic steps run to catch up each time the logic
+** task runs. If we are further behind than this, the remaining steps
+** are dropped. With LOGIC_SPEEDUP each run is due LOGIC_SPEEDUP times
+** as many steps, so the limit is scaled to match - otherwise the
+** extra speed would just be dropped.
+*/
+#define MAX_CATCHUP_STEPS 4
+#define MAX_LOGIC_STEPS_PER_RUN (MAX_CATCHUP_STEPS * LOGIC_SPEEDUP)
+
+#if MAX_LOGIC_STEPS_PER_RUN > 255
+#error "LOGIC_SPEEDUP is too large"
+#endif
+
+/* Flag to keep track of whether the game field changes or.
+** We use this to know whether we must redraw the dispaly
+** or not. Set by the tasks below that advance the game.
+*/
+static uint8_t gameFieldUpdated = 0;
+
+/* Keep track of the previous joystick button values - so we know
+** whether the buttons have changed or not.
+*/
+static uint8_t prevJoystickButtons = 0;
+
+/* Game logic time keeping. logicTime is the clock tick value when
+** the logic task last ran; logicAccumulator is the amount of time
+** (in milliseconds) that has passed but has not yet been simulated.
+*/
+static uint32_t logicTime;
+static uint32_t logicAccumulator;
+
+/* Set if the game logic has been stopped from following real time by
+** step_game_logic(), and the number of steps still to be run.
+*/
+static uint8_t logicHeld = 0;
+static uint16_t logicStepsLeft = 0;
+
+/* Data saved in EEPROM - the high score and settings (see
+** persist.h).
+*/
+static PersistData savedData;
+
+/* Buttons on the board (bit values for button_task()) */
+#define BUTTON_RESET 0x01	/* PD7 */
+#define BUTTON_PAUSE 0x02	/* PD5 */
+
+/* Buttons that were down the last time button_task() ran, and
+** buttons that have been pressed since then but not yet dealt with.
+*/
+static uint8_t prevButtons = 0;
+static uint8_t buttonPresses = 0;
+
+/* Flag set by scroll_task() when the scrolling message is complete */
+static uint8_t scrollFinished;
+
+/* IDs of our scheduled tasks (see scheduler.h) */
+static uint8_t scrollTask = NO_TASK;
+static uint8_t joystickTask = NO_TASK;
+static uint8_t logicTask = NO_TASK;
+
 /*
 ** Function prototypes - these are defined below main()
 */
@@ -38,30 +125,36 @@ void new_game(void);
 void handle_game_over(void);
 void gameOver(void);
 void game_pause_loop(void);
+void report_watchdog_reset(void);
+
+/* Scheduled tasks */
+static void scroll_task(void);
+static void joystick_task(void);
+static void logic_task(void);
+static void stack_check_task(void);
+static void button_task(void);
+
+/* Helper functions */
+static void logic_step(void);
+static void reset_logic_time(void);
+static void start_scrolling(char* message);
+static void stop_scrolling(void);
+static void add_game_tasks(void);
+static void update_high_score(void);
+static uint8_t take_button_press(uint8_t button);
+static void suspend_game_tasks(void);
+static void resume_game_tasks(void);
 
 /*
  * main -- Main program.
  */
 int main(void) {
-	/* Flag to keep track of whether the game field changes or.
-	** We use this to know whether we must redraw the dispaly
-	** or not.
-	*/
-	uint8_t gameFieldUpdated = 0;
+	initialise_hardware();
 
-	/* Keep track of the previous joystick values - so we know
-	** whether the joystick (X position or buttons) have changed
-	** or not.
+	/* If the watchdog reset us, say so (and which task was
+	** running) before anything else.
 	*/
-	int8_t prevJoystickX;
-	uint8_t prevJoystickButtons;
-	uint32_t currentTime;				/* clock ticks */
-	uint32_t displayLastUpdatedTime = 0;	/* clock ticks */
-	uint32_t joystickLastCheckedTime = 0;	/* clock ticks */
-	uint32_t projectilesLastAdvancedTime = 0; /* clock ticks */
-	uint32_t asteroidsLastAdvancedTime = 0; /* clock ticks */
-	
-	initialise_hardware();
+	report_watchdog_reset();
 
 	/* Show the splash screen message. This returns when 
 	** message display is complete. */
@@ -70,79 +163,52 @@ int main(void) {
 	/* Perform necessary initialisations for a new game. */
 	new_game();
 		
-	/*
-	** Event loop. We wait for various times to be reached
-	** to take actions (e.g. advancing projectiles up the 
-	** screen.) We monitor various button values to check
-	** whether they have changed.
-	*/
-	prevJoystickX = 0;
-	prevJoystickButtons = 0;
-	while(1) {
-		currentTime = get_clock_ticks();
-		if(currentTime >= projectilesLastAdvancedTime + 1000) {
-			/* Advance any projectiles every 1000ms. */
-			gameFieldUpdated |= advance_projectiles();
-			projectilesLastAdvancedTime = currentTime;
-		}
+	/* Start the tasks that advance the game */
+	add_game_tasks();
 
-		if(currentTime >= asteroidsLastAdvancedTime + getAsteroidFallInterval()) {
-			/* Advance any asteroids. */
-			gameFieldUpdated |= advance_asteroids();
-			asteroidsLastAdvancedTime = currentTime;
-		}
+	/* Check every 100ms that the stack hasn't grown into the
+	** global variables.
+	*/
+	add_task(stack_check_task, 100, 0);
 
-		/* Check clock tick value and take action if necessary */
-		
-		if(currentTime >= displayLastUpdatedTime + 2) {
-			/* Update LED display every 2ms - i.e. show a different row */
-			display_row();
-			displayLastUpdatedTime = currentTime;
-		}
+	/* Check the buttons every 20ms */
+	add_task(button_task, 20, 0);
 
-		if(currentTime >= joystickLastCheckedTime + 4) {
-			/* Check the joystick every 4ms */
-			joystick_update();
-			joystickLastCheckedTime = currentTime;
-		}
-		
-		if (lapse > 10000) {
-			/* Joystick has moved left or right */	
-			if(joystickX < 0) {
-				/* Joystick has moved left */ 
-				gameFieldUpdated |= move_base(MOVE_LEFT);
-				direction = 'L';
-			}
-			if(joystickX > 0) {
-				gameFieldUpdated |= move_base(MOVE_RIGHT);
-				direction = 'R';
-			}
-			/* Update our record of the previous Joystick value */
-			prevJoystickX = joystickX;
+	/* Start sending telemetry and the contents of the display
+	** over the serial port
+	*/
+	init_telemetry();
+	init_display_mirror();
 
-		lapse = 0;
+	/* Accept commands (e.g. from test scripts) over the serial
+	** port
+	*/
+	init_command();
 
-		} else {
-			lapse++;
-		}
+	/*
+	** Event loop. We run the scheduled tasks that are due
+	** (e.g. the game logic steps.) We then show the latest
+	** state of the game and monitor various button values to
+	** check whether they have changed.
+	*/
+	while(1) {
+		watchdog_loop_start();
+		telemetry_count_loop();
+		run_due_tasks();
 		
-
-
-
-		if(prevJoystickButtons != joystickButtons) {
-			/* A joystick button has been pressed or released */
-			if(BUTTON_1_PRESSED(joystickButtons) && 
-					!BUTTON_1_PRESSED(prevJoystickButtons)) {
-				/* Button one has been pressed */
-				gameFieldUpdated = fire_projectile();
-			}
-			prevJoystickButtons = joystickButtons;
-		}
 		if(gameFieldUpdated) {
 			/* 
 			** Update display of board since its appearance has changed.
+			** (However many logic steps have been run, we only
+			** need to show the latest state.)
 			*/
+			PROFILE_BEGIN(PROF_COPY_FIELD);
+			TRACE_BEGIN(TRACE_COPY_FIELD);
 			copy_game_field_to_led_display();
+			TRACE_END(TRACE_COPY_FIELD);
+			PROFILE_END(PROF_COPY_FIELD);
+			INPUT_LATENCY_MARK(INPUT_COPIED, 0);
+			telemetry_count_frame();
 			
 			// Update Health Output
 			if (getHealth() <= 0) {
@@ -154,13 +220,8 @@ int main(void) {
 			gameFieldUpdated = 0;
 		}
 		//Reset Button
-		if((PIND & (1<<7)) == (1<<7)) {
-			
-			while((PIND & (1<<7)) == (1<<7)) {
-			}
-			if (high_score < get_score()) {
-				high_score = get_score();
-			}
+		if(take_button_press(BUTTON_RESET)) {
+			update_high_score();
 			add_to_score(10);
 			new_game();
 		}
@@ -171,80 +232,110 @@ int main(void) {
 		}
 		
 		// Pause Game
-		if ((PIND & (1<<5)) == (1<<5)) {
-			while ((PIND & (1<<5)) == (1<<5)) { /* wait for button release */ }
+		if (take_button_press(BUTTON_PAUSE)) {
 			game_pause_loop();
 		}
+
+		/* Nothing more to do until the next task is due (or
+		** an interrupt, e.g. a joystick update, wakes us up).
+		*/
+		watchdog_loop_end();
+		sleep_until(next_task_deadline());
 	}
 }
 
 void gameOver() {
-	uint32_t currentTime;
-	uint32_t displayLastUpdatedTime = 0;
-	uint32_t displayLastScrolledTime = 0;
+	/* The game tasks are stopped while the message scrolls. (We
+	** may have been called from one of those tasks.)
+	*/
+	suspend_game_tasks();
+	sfx_trigger(SFX_GAME_OVER);
 	
 	/* This is the text we'll scroll on the LED display. */
-	set_display_text("GAME OVER");
+	start_scrolling("GAME OVER");
 	
-	/* We scroll the message until the display is blank */
-	while(1) {
-		currentTime = get_clock_ticks();
-		
-		if(currentTime >= displayLastUpdatedTime + 2) {
-			/* Update LED display every 2ms - i.e. show a different row */
-			display_row();
-			displayLastUpdatedTime = currentTime;
-		}
-		
-		if(currentTime >= displayLastScrolledTime + 150) {
-			/* Scroll our message every 150ms. Exit the loop
-			 ** if finished.
-			 */
-			if(!scroll_display()) {
-				break;
-			}
-			displayLastScrolledTime = currentTime;
-		}
+	/* We scroll the message until the display is blank. (This
+	** is inside an iteration of the event loop, so the loop
+	** timing is ended before each sleep and started again after
+	** it - the time the message is up is not a stall.)
+	*/
+	while(!scrollFinished) {
+		run_due_tasks();
+		watchdog_loop_end();
+		sleep_until(next_task_deadline());
+		watchdog_loop_start();
 	}	
+	stop_scrolling();
 	
+	update_high_score();
 	new_game();
+	resume_game_tasks();
 }
 
 void game_pause_loop() {
-	uint32_t currentTime;
-	uint32_t displayLastUpdatedTime = 0;
-	uint32_t displayLastScrolledTime = 0;
+	suspend_game_tasks();
 	
 	/* This is the text we'll scroll on the LED display. */
-	//set_display_text("Jake Schoermer s4233158 Sam Pengilly s42351382");
-	set_display_text("Paused");
+	//start_scrolling("Jake Schoermer s4233158 Sam Pengilly s42351382");
+	start_scrolling("Paused");
 	
-	/* We scroll the message until the display is blank */
+	/* We scroll the message (and then a blank display) until
+	** the game is unpaused.
+	*/
 	while(1) {
-		currentTime = get_clock_ticks();
-		
-		if(currentTime >= displayLastUpdatedTime + 2) {
-			/* Update LED display every 2ms - i.e. show a different row */
-			display_row();
-			displayLastUpdatedTime = currentTime;
-		}
-		
-		if(currentTime >= displayLastScrolledTime + 150) {
-			/* Scroll our message every 150ms. Exit the loop
-			 ** if finished.
-			 */
-			if(!scroll_display()) {
-				//break;
-			}
-			displayLastScrolledTime = currentTime;
-		}
+		run_due_tasks();
 
 		// Unpause Game
-		if ((PIND & (1<<5)) == (1<<5)) {
-			while ((PIND & (1<<5)) == (1<<5)) { /* wait for button release */ }
+		if (take_button_press(BUTTON_PAUSE)) {
 			break;
 		}
+		/* (As in gameOver()) */
+		watchdog_loop_end();
+		sleep_until(next_task_deadline());
+		watchdog_loop_start();
+	}
+	stop_scrolling();
+	resume_game_tasks();
+}
+
+void step_game_logic(uint16_t steps) {
+	logicHeld = 1;
+	logicStepsLeft += steps;
+	if(logicStepsLeft < steps) {
+		/* Overflowed */
+		logicStepsLeft = 0xFFFF;
+	}
+}
+
+void release_game_logic(void) {
+	logicHeld = 0;
+	logicStepsLeft = 0;
+	reset_logic_time();
+}
+
+uint16_t game_logic_steps_left(void) {
+	return logicStepsLeft;
+}
+
+void report_watchdog_reset(void) {
+	/* The task number is filled in below */
+	static char message[] = "Watchdog reset in task 0";
+	PostMortem record;
+
+	if(!watchdog_get_post_mortem(&record)) {
+		return;
+	}
+	if(record.taskId == NO_TASK) {
+		start_scrolling("Watchdog reset");
+	} else {
+		message[sizeof(message) - 2] = '0' + record.taskId;
+		start_scrolling(message);
 	}
+	while(!scrollFinished) {
+		run_due_tasks();
+		sleep_until(next_task_deadline());
+	}
+	stop_scrolling();
 }
 
 void initialise_hardware(void) {
@@ -252,16 +343,40 @@ void initialise_hardware(void) {
 	** registers etc. This should only need to be done once.
 	*/
 
+	/* Check whether the watchdog reset us, then start it */
+	init_watchdog();
+
 	/* Initialise the LED board display */
 	init_display();
 
-	/* Initialise communication with the Joystick */
+	/* Initialise the shared SPI bus, then communication
+	** with the Joystick (which is on that bus)
+	*/
+	init_spi();
 	init_joystick();
 
+	/* Initialise the serial port (for telemetry) */
+	init_uart();
+
 	/* Initialise the timer which gives us clock ticks
-	** to time things by.
+	** to time things by, and the scheduler which uses them.
 	*/
 	init_timer2();
+	init_scheduler();
+
+	/* Start the cycle counter used for profiling, the sampling
+	** profiler, interrupt latency measurement, interrupts-off
+	** time tracing, input latency measurement and the timeline
+	** trace (if they are enabled - see profile.h, sampler.h,
+	** isr_latency.h, atomic_section.h, input_latency.h and
+	** trace.h)
+	*/
+	init_profile();
+	init_sampler();
+	init_isr_latency();
+	init_atomic_trace();
+	init_input_latency();
+	init_trace();
 
 	/* Initialise SSEG Score
 	**
@@ -281,6 +396,11 @@ void initialise_hardware(void) {
 
 	init_sfx();
 
+	/* Load the saved high score */
+	init_persist();
+	persist_load(&savedData);
+	high_score = savedData.highScore;
+
 	/*
 	** Turn on interrupts (needed for timer to work)
 	*/
@@ -290,43 +410,218 @@ void initialise_hardware(void) {
 
 void splash_screen(void) 
 {
-	uint32_t currentTime;
-	uint32_t displayLastUpdatedTime = 0;
-	uint32_t displayLastScrolledTime = 0;
-
 	/* This is the text we'll scroll on the LED display. */
-	set_display_text("Jake Schoermer s4233158 Sam Pengilly s42351382");
-	//set_display_text("s");
+	start_scrolling("Jake Schoermer s4233158 Sam Pengilly s42351382");
+	//start_scrolling("s");
 
 	/* We scroll the message until the display is blank */
-	while(1) {
-		currentTime = get_clock_ticks();
-		
-		if(currentTime >= displayLastUpdatedTime + 2) {
-			/* Update LED display every 2ms - i.e. show a different row */
-			display_row();
-			displayLastUpdatedTime = currentTime;
-		}
-
-		if(currentTime >= displayLastScrolledTime + 150) {
-			/* Scroll our message every 150ms. Exit the loop
-			** if finished.
-			*/
-			if(!scroll_display()) {
-				break;
-			}
-			displayLastScrolledTime = currentTime;
-		}
+	while(!scrollFinished) {
+		run_due_tasks();
+		sleep_until(next_task_deadline());
 	}		
+	stop_scrolling();
 }
 
 void new_game(void) 
 {
+	/* Each game starts from a seed of its own: the random number
+	** generator carries on from the last game, and its state is
+	** recorded as the seed (see get_game_seed()), which the
+	** autopilot is seeded with too.
+	*/
+	set_game_seed(get_random_state());
+
 	/* 
 	** Initialise the game field and the screen
 	*/
 	init_game_field();
 	copy_game_field_to_led_display();
 	init_score();
+
+	/* If the autopilot is playing, it starts again too */
+	init_autopilot();
 }
 
+/********************** TASKS ******************************/
+
+static void scroll_task(void) {
+	/* Scroll our message every 150ms. Record when it is finished. */
+	PROFILE_BEGIN(PROF_SCROLL_DISPLAY);
+	if(!scroll_display()) {
+		scrollFinished = 1;
+	}
+	PROFILE_END(PROF_SCROLL_DISPLAY);
+}
+
+static void joystick_task(void) {
+	/* Check the joystick every 4ms */
+	PROFILE_BEGIN(PROF_JOYSTICK_UPDATE);
+	joystick_update();
+	PROFILE_END(PROF_JOYSTICK_UPDATE);
+}
+
+static void logic_task(void) {
+	/* Run the game logic in fixed steps of LOGIC_TICK_MS. We add
+	** the time since we last ran to the accumulator and run one
+	** step for each LOGIC_TICK_MS it holds - so if we run late,
+	** the steps are made up rather than skipped. (We're normally
+	** run every LOGIC_TICK_MS so this is usually one step.)
+	*/
+	uint8_t steps = 0;
+	uint32_t currentTime = get_clock_ticks();
+
+	if(logicHeld) {
+		/* Only run the steps we've been asked to run */
+		while(logicStepsLeft && steps < MAX_CATCHUP_STEPS) {
+			logicStepsLeft--;
+			PROFILE_BEGIN(PROF_LOGIC_STEP);
+			logic_step();
+			PROFILE_END(PROF_LOGIC_STEP);
+			steps++;
+		}
+		return;
+	}
+
+	/* (Use the time read above - reading the clock again could
+	** count a tick twice.)
+	*/
+	logicAccumulator += (currentTime - logicTime) * LOGIC_SPEEDUP;
+	logicTime = currentTime;
+
+	while(logicAccumulator >= LOGIC_TICK_MS) {
+		if(steps == MAX_LOGIC_STEPS_PER_RUN) {
+			/* Too far behind to catch up - drop the remaining
+			** whole steps so that we don't fall further behind.
+			*/
+			dropped_logic_steps += logicAccumulator / LOGIC_TICK_MS;
+			logicAccumulator %= LOGIC_TICK_MS;
+			break;
+		}
+		logicAccumulator -= LOGIC_TICK_MS;
+		PROFILE_BEGIN(PROF_LOGIC_STEP);
+		logic_step();
+		PROFILE_END(PROF_LOGIC_STEP);
+		steps++;
+	}
+}
+
+static void stack_check_task(void) {
+	/* If the stack has reached the guard zone, turn on both
+	** joystick LEDs to show that something is badly wrong.
+	*/
+	if(!stack_check()) {
+		set_joystick_leds(1, 1);
+	}
+}
+
+static void button_task(void) {
+	/* Record the buttons that have been pressed since we last
+	** looked. (Checking only every 20ms means we don't see
+	** contact bounce as extra presses.)
+	*/
+	uint8_t buttons = 0;
+
+	if((PIND & (1<<7)) == (1<<7)) {
+		buttons |= BUTTON_RESET;
+	}
+	if((PIND & (1<<5)) == (1<<5)) {
+		buttons |= BUTTON_PAUSE;
+	}
+	buttonPresses |= buttons & ~prevButtons;
+	prevButtons = buttons;
+}
+
+/****************** HELPER FUNCTIONS ***********************/
+
+/* Run one step of the game logic with the current joystick
+** values as input.
+*/
+static void logic_step(void) {
+	int8_t moveDirection = MOVE_NONE;
+	uint8_t fire;
+	uint8_t buttons;
+
+	TRACE_BEGIN(TRACE_LOGIC_STEP);
+
+	/* If the autopilot is playing, it moves the joystick now */
+	AUTOPILOT_STEP();
+	buttons = joystickButtons;
+	if(joystickX < 0) {
+		/* Joystick has moved left */
+		moveDirection = MOVE_LEFT;
+		direction = 'L';
+	} else if(joystickX > 0) {
+		moveDirection = MOVE_RIGHT;
+		direction = 'R';
+	}
+
+	/* Fire if button one has been pressed since the last step */
+	fire = BUTTON_1_PRESSED(buttons) && !BUTTON_1_PRESSED(prevJoystickButtons);
+	prevJoystickButtons = buttons;
+	if(fire) {
+		INPUT_LATENCY_MARK(INPUT_STEP, 0);
+	}
+
+	gameFieldUpdated |= game_step(moveDirection, fire);
+	TRACE_END(TRACE_LOGIC_STEP);
+}
+
+/* Start the game logic time from now - any time that passed while
+** the logic task was suspended is not simulated.
+*/
+static void reset_logic_time(void) {
+	logicTime = get_clock_ticks();
+	logicAccumulator = 0;
+}
+
+/* Start scrolling the given message on the LED display. The scroll
+** task runs until stop_scrolling() is called.
+*/
+static void start_scrolling(char* message) {
+	set_display_text(message);
+	scrollFinished = 0;
+	scrollTask = add_task(scroll_task, 150, 0);
+}
+
+static void stop_scrolling(void) {
+	remove_task(scrollTask);
+	scrollTask = NO_TASK;
+}
+
+/* Record the score as the new high score if it is one, and save
+** it to EEPROM (in the background).
+*/
+static void update_high_score(void) {
+	if (high_score < get_score()) {
+		high_score = get_score();
+		savedData.highScore = high_score;
+		persist_save(&savedData);
+	}
+}
+
+/* Returns 1 if the given button (BUTTON_RESET etc.) has been pressed
+** since we last checked, 0 otherwise.
+*/
+static uint8_t take_button_press(uint8_t button) {
+	uint8_t pressed = buttonPresses & button;
+
+	buttonPresses &= ~button;
+	return pressed != 0;
+}
+
+static void add_game_tasks(void) {
+	joystickTask = add_task(joystick_task, 4, 0);
+	reset_logic_time();
+	logicTask = add_task(logic_task, LOGIC_TICK_MS, LOGIC_TICK_MS);
+}
+
+static void suspend_game_tasks(void) {
+	suspend_task(joystickTask);
+	suspend_task(logicTask);
+}
+
+static void resume_game_tasks(void) {
+	resume_task(joystickTask);
+	reset_logic_time();
+	resume_task(logicTask);
+}
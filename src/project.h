@@ -8,4 +8,18 @@ extern uint8_t seven_seg_data[];
 
 extern uint8_t seven_seg_cat;
 
+extern uint16_t dropped_logic_steps;
+
+/* Stepping the game logic (e.g. for automated tests - see command.h).
+** step_game_logic() stops the game logic following real time and
+** queues the given number of logic steps, which are then run (at up
+** to MAX_CATCHUP_STEPS each time the logic task runs). The game stays
+** held once they have run, until release_game_logic() is called.
+** game_logic_steps_left() returns the number of queued steps not yet
+** run.
+*/
+void step_game_logic(uint16_t steps);
+void release_game_logic(void);
+uint16_t game_logic_steps_left(void);
+
 #endif /*_CSSE1000_MAIN*/
@@ -0,0 +1,162 @@
+/*
+** sampler.c
+**
+** Sampling profiler - see sampler.h.
+**
+** Timer 1 counts CPU cycles (normal mode, no prescaling). The output
+** compare B interrupt is moved on by SAMPLE_INTERVAL each time it
+** fires, so it fires every SAMPLE_INTERVAL cycles.
+**
+** When an interrupt happens the CPU pushes the address of the next
+** instruction of the interrupted code on the stack (high byte at the
+** lower address). The interrupt handler is "naked" - we write the
+** register saving code ourselves - so we know exactly how far down
+** the stack that address is.
+*/
+
+#include "hal.h"
+#include "sampler.h"
+#include "isr_latency.h"
+#include "atomic_section.h"
+
+#ifdef SAMPLE_PROFILE
+
+#ifdef SFX_DDS
+#error "SAMPLE_PROFILE and SFX_DDS can't be used together - both need timer 1"
+#endif
+
+#if SAMPLE_INTERVAL < 256 || SAMPLE_INTERVAL > 65535
+#error "SAMPLE_INTERVAL must be between 256 and 65535"
+#endif
+
+static uint16_t buckets[SAMPLE_BUCKETS];
+static uint32_t totalSamples;
+
+/* Private functions - only used within this module */
+static void record_sample(uint16_t pc) __attribute__((used));
+
+/* See comment in .h file */
+void init_sampler(void)
+{
+	sampler_reset();
+
+	/* Timer 1 runs freely at the CPU clock rate (it may also be
+	** in use by profile.c, which sets it up the same way).
+	*/
+	TCCR1A = 0;
+	TCCR1B = (1<<CS10);
+	OCR1B = TCNT1 + SAMPLE_INTERVAL;
+	hal_clear_timer_flags(1<<OCF1B);
+	TIMSK |= (1<<OCIE1B);
+}
+
+/* See comment in .h file */
+uint16_t sampler_get_bucket(uint8_t bucket)
+{
+	uint16_t count;
+
+	if(bucket >= SAMPLE_BUCKETS) {
+		return 0;
+	}
+	ATOMIC_SECTION(ATOMIC_SAMPLER_STATS) {
+		count = buckets[bucket];
+	}
+	return count;
+}
+
+/* See comment in .h file */
+uint32_t sampler_get_total(void)
+{
+	uint32_t total;
+
+	ATOMIC_SECTION(ATOMIC_SAMPLER_STATS) {
+		total = totalSamples;
+	}
+	return total;
+}
+
+/* See comment in .h file */
+void sampler_reset(void)
+{
+	uint8_t i;
+
+	ATOMIC_SECTION(ATOMIC_SAMPLER_STATS) {
+		for(i=0; i < SAMPLE_BUCKETS; i++) {
+			buckets[i] = 0;
+		}
+		totalSamples = 0;
+	}
+}
+
+/* Sample interrupt. We save the registers that a C function may
+** change (15 bytes), fetch the interrupted program counter from just
+** above them on the stack and pass it to record_sample().
+*/
+ISR(TIMER1_COMPB_vect, ISR_NAKED)
+{
+	asm volatile(
+		"push r1"				"\n\t"
+		"push r0"				"\n\t"
+		"in r0, __SREG__"		"\n\t"
+		"push r0"				"\n\t"
+		"clr r1"				"\n\t"
+		"push r18"				"\n\t"
+		"push r19"				"\n\t"
+		"push r20"				"\n\t"
+		"push r21"				"\n\t"
+		"push r22"				"\n\t"
+		"push r23"				"\n\t"
+		"push r24"				"\n\t"
+		"push r25"				"\n\t"
+		"push r26"				"\n\t"
+		"push r27"				"\n\t"
+		"push r30"				"\n\t"
+		"push r31"				"\n\t"
+		"in r30, __SP_L__"		"\n\t"
+		"in r31, __SP_H__"		"\n\t"
+		"ldd r25, Z+16"			"\n\t"	/* return address high byte */
+		"ldd r24, Z+17"			"\n\t"	/* return address low byte */
+		"call record_sample"	"\n\t"
+		"pop r31"				"\n\t"
+		"pop r30"				"\n\t"
+		"pop r27"				"\n\t"
+		"pop r26"				"\n\t"
+		"pop r25"				"\n\t"
+		"pop r24"				"\n\t"
+		"pop r23"				"\n\t"
+		"pop r22"				"\n\t"
+		"pop r21"				"\n\t"
+		"pop r20"				"\n\t"
+		"pop r19"				"\n\t"
+		"pop r18"				"\n\t"
+		"pop r0"				"\n\t"
+		"out __SREG__, r0"		"\n\t"
+		"pop r0"				"\n\t"
+		"pop r1"				"\n\t"
+		"reti"
+	);
+}
+
+/****************** INTERNAL FUNCTIONS *********************/
+
+/* record_sample()
+**  - count a sample at the given program counter (a flash word
+**    address) and set the time of the next sample.
+*/
+static void record_sample(uint16_t pc)
+{
+	uint16_t bucket = ((uint32_t)pc * 2) / SAMPLE_BUCKET_BYTES;
+
+	ISR_LATENCY_RECORD(LATENCY_SAMPLER, TCNT1 - OCR1B);
+	OCR1B += SAMPLE_INTERVAL;
+
+	if(bucket >= SAMPLE_BUCKETS) {
+		bucket = SAMPLE_BUCKETS - 1;
+	}
+	if(buckets[bucket] != 0xFFFF) {
+		buckets[bucket]++;
+	}
+	totalSamples++;
+}
+
+#endif
@@ -0,0 +1,83 @@
+/*
+** sampler.h
+**
+** Statistical (sampling) profiler. Every SAMPLE_INTERVAL CPU cycles
+** an interrupt records where the program was when it was
+** interrupted, by adding one to the count of the range of flash
+** addresses (the "bucket") it was in. Over a few seconds this builds
+** up a picture of where the CPU spends its time, including code that
+** has no profile probes (see profile.h) and time spent asleep.
+**
+** Interrupts are off while other interrupt handlers run, so a sample
+** that falls due then is taken just after the handler returns: time
+** spent in other interrupt handlers is counted against whatever code
+** they interrupted, not the handlers themselves.
+**
+** The counts can be read with sampler_get_bucket(); the host tool
+** tools/sample_profile.py turns them into a list of functions using
+** the symbol table of the .elf file.
+**
+** The sampler is only compiled in if SAMPLE_PROFILE is defined. It
+** uses timer 1 (as a free running cycle counter, like profile.c, and
+** its output compare B interrupt) so can't be used with the DDS
+** synthesiser.
+*/
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdint.h>
+
+/* CPU cycles between samples. Each sample takes roughly 130 to 150
+** cycles (about 74 for the interrupt itself - entry, the 15 registers
+** saved and restored, the call and the RETI - plus the counting in
+** record_sample()), so the default (about 1000 samples a second)
+** costs about 1.7% of the CPU. An odd number is used so that samples don't stay in step
+** with the 1ms timer tick.
+*/
+#ifndef SAMPLE_INTERVAL
+#define SAMPLE_INTERVAL 8191
+#endif
+
+/* Size of each bucket (in bytes of flash) and the number of
+** buckets. Samples beyond the last bucket are counted in it.
+*/
+#ifndef SAMPLE_BUCKET_BYTES
+#define SAMPLE_BUCKET_BYTES 128
+#endif
+#ifndef SAMPLE_BUCKETS
+#define SAMPLE_BUCKETS 128
+#endif
+
+#ifdef SAMPLE_PROFILE
+
+/* init_sampler()
+** - starts sampling (once interrupts are enabled), with all the
+** counts cleared.
+*/
+void init_sampler(void);
+
+/* sampler_get_bucket()
+** - returns the number of samples in the given bucket (which covers
+** flash addresses bucket * SAMPLE_BUCKET_BYTES onwards). Counts stop
+** at 65535.
+*/
+uint16_t sampler_get_bucket(uint8_t bucket);
+
+/* sampler_get_total()
+** - returns the total number of samples taken.
+*/
+uint32_t sampler_get_total(void);
+
+/* sampler_reset()
+** - clears all the counts.
+*/
+void sampler_reset(void);
+
+#else
+
+#define init_sampler()
+
+#endif
+
+#endif
@@ -0,0 +1,234 @@
+/*
+** scheduler.c
+**
+** Cooperative task scheduler - see scheduler.h.
+**
+** Each task occupies a slot in the tasks array. Tasks waiting to run
+** are linked together (through the "next" member) in order of their
+** deadlines; listHead is the task with the earliest deadline. A task
+** is taken off the list while it runs and put back on (with its new
+** deadline) when it returns.
+**
+** These functions must only be called from the main program, not from
+** interrupt handlers.
+*/
+
+#include "scheduler.h"
+#include "timer2.h"
+#include "watchdog.h"
+#include "trace.h"
+
+/* Task flags */
+#define TASK_USED 0x01		/* slot is in use */
+#define TASK_QUEUED 0x02	/* task is on the deadline list */
+#define TASK_RUNNING 0x04	/* task is running now */
+#define TASK_SUSPENDED 0x08	/* task is not to be run */
+
+typedef struct {
+	void (*function)(void);
+	uint32_t deadline;		/* clock ticks */
+	uint16_t period;		/* milliseconds, 0 for one-shot */
+	uint16_t overruns;
+	uint8_t flags;
+	uint8_t next;			/* next task on the list, or NO_TASK */
+} Task;
+
+static Task tasks[MAX_TASKS];
+static uint8_t listHead;
+
+/* Private functions - only used within this module */
+static void insert_task(uint8_t taskId);
+static void unlink_task(uint8_t taskId);
+
+/* See comment in .h file */
+void init_scheduler(void)
+{
+	uint8_t i;
+
+	for(i=0; i < MAX_TASKS; i++) {
+		tasks[i].flags = 0;
+	}
+	listHead = NO_TASK;
+}
+
+/* See comment in .h file */
+uint8_t add_task(void (*function)(void), uint16_t period, uint16_t phase)
+{
+	uint8_t i;
+
+	for(i=0; i < MAX_TASKS; i++) {
+		if(tasks[i].flags == 0) {
+			/* Found a free slot */
+			tasks[i].function = function;
+			tasks[i].period = period;
+			tasks[i].overruns = 0;
+			tasks[i].deadline = get_clock_ticks() + phase;
+			tasks[i].flags = TASK_USED;
+			insert_task(i);
+			return i;
+		}
+	}
+	return NO_TASK;
+}
+
+/* See comment in .h file */
+void remove_task(uint8_t taskId)
+{
+	if(taskId >= MAX_TASKS) {
+		return;
+	}
+	unlink_task(taskId);
+	/* If the task is running, we leave the running flag set so the
+	** slot can't be reused until the task has returned.
+	*/
+	tasks[taskId].flags &= TASK_RUNNING;
+}
+
+/* See comment in .h file */
+void set_task_period(uint8_t taskId, uint16_t period)
+{
+	if(taskId < MAX_TASKS) {
+		tasks[taskId].period = period;
+	}
+}
+
+/* See comment in .h file */
+void suspend_task(uint8_t taskId)
+{
+	if(taskId < MAX_TASKS && (tasks[taskId].flags & TASK_USED)) {
+		unlink_task(taskId);
+		tasks[taskId].flags |= TASK_SUSPENDED;
+	}
+}
+
+/* See comment in .h file */
+void resume_task(uint8_t taskId)
+{
+	if(taskId >= MAX_TASKS || !(tasks[taskId].flags & TASK_SUSPENDED)) {
+		return;
+	}
+	tasks[taskId].flags &= ~TASK_SUSPENDED;
+	if(!(tasks[taskId].flags & TASK_RUNNING)) {
+		/* (A running task is put back on the list when it returns.) */
+		tasks[taskId].deadline = get_clock_ticks() + tasks[taskId].period;
+		insert_task(taskId);
+	}
+}
+
+/* See comment in .h file */
+uint16_t get_task_overruns(uint8_t taskId)
+{
+	if(taskId >= MAX_TASKS) {
+		return 0;
+	}
+	return tasks[taskId].overruns;
+}
+
+/* See comment in .h file */
+uint8_t run_due_tasks(void)
+{
+	uint8_t taskId;
+	uint8_t tasksRun = 0;
+	uint32_t currentTime = get_clock_ticks();
+	uint32_t startTime;
+	uint8_t previousTask;
+	Task* task;
+
+	/* We're still running, so don't let the watchdog reset us */
+	watchdog_kick();
+
+	/* The list is sorted by deadline, so we only need to check the
+	** task at the front. We stop at the first task not yet due.
+	*/
+	while(listHead != NO_TASK &&
+			TIME_REACHED(currentTime, tasks[listHead].deadline)) {
+		taskId = listHead;
+		task = &tasks[taskId];
+		unlink_task(taskId);
+
+		task->flags |= TASK_RUNNING;
+		startTime = get_clock_micros();
+		previousTask = watchdog_task_start(taskId);
+		TRACE_BEGIN(TRACE_TASK + taskId);
+		task->function();
+		TRACE_END(TRACE_TASK + taskId);
+		watchdog_task_end(taskId, previousTask,
+				get_clock_micros() - startTime);
+		task->flags &= ~TASK_RUNNING;
+		tasksRun++;
+
+		if(!(task->flags & TASK_USED)) {
+			/* Task removed itself while it was running */
+			continue;
+		}
+		if(task->period == 0) {
+			/* One-shot task - finished with it */
+			task->flags = 0;
+			continue;
+		}
+
+		/* Work out the next deadline. If we're so late that we've
+		** missed the next run altogether, record an overrun and
+		** schedule from now instead.
+		*/
+		task->deadline += task->period;
+		if(TIME_REACHED(currentTime, task->deadline)) {
+			task->overruns++;
+			task->deadline = currentTime + task->period;
+		}
+		if(!(task->flags & TASK_SUSPENDED)) {
+			insert_task(taskId);
+		}
+	}
+	return tasksRun;
+}
+
+/* See comment in .h file */
+uint32_t next_task_deadline(void)
+{
+	if(listHead == NO_TASK) {
+		return get_clock_ticks() + 0x7FFFFFFFUL;
+	}
+	return tasks[listHead].deadline;
+}
+
+/****************** INTERNAL FUNCTIONS *********************/
+
+/* insert_task()
+**  - add a task to the list in deadline order. A task is placed
+**    after any others with the same deadline so that they run in
+**    the order they became due. Does nothing if the task is
+**    already on the list.
+*/
+static void insert_task(uint8_t taskId)
+{
+	uint8_t* link = &listHead;
+	uint32_t deadline = tasks[taskId].deadline;
+
+	if(tasks[taskId].flags & TASK_QUEUED) {
+		return;
+	}
+	while(*link != NO_TASK && TIME_REACHED(deadline, tasks[*link].deadline)) {
+		link = &tasks[*link].next;
+	}
+	tasks[taskId].next = *link;
+	*link = taskId;
+	tasks[taskId].flags |= TASK_QUEUED;
+}
+
+/* unlink_task()
+**  - take a task off the list (if it is on it).
+*/
+static void unlink_task(uint8_t taskId)
+{
+	uint8_t* link = &listHead;
+
+	if(!(tasks[taskId].flags & TASK_QUEUED)) {
+		return;
+	}
+	while(*link != taskId) {
+		link = &tasks[*link].next;
+	}
+	*link = tasks[taskId].next;
+	tasks[taskId].flags &= ~TASK_QUEUED;
+}
@@ -0,0 +1,83 @@
+/*
+** scheduler.h
+**
+** Cooperative task scheduler. Tasks are functions that are run from
+** the main event loop (not from interrupts) when their deadline (in
+** clock ticks - see timer2.h) is reached. Tasks can be periodic (run
+** every "period" milliseconds) or one-shot (run once).
+**
+** Tasks are kept in a list sorted by deadline, so run_due_tasks() only
+** has to look at the front of the list to know whether anything needs
+** to be done.
+**
+** A task may itself call run_due_tasks() (e.g. to keep the display
+** going while a message scrolls) - the task is not run again until it
+** returns.
+*/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+/* Maximum number of tasks that can be registered at once */
+#define MAX_TASKS 10
+
+/* Task ID returned by add_task() if there is no room for the task */
+#define NO_TASK 0xFF
+
+/* init_scheduler()
+** - must be called before any tasks are added. Removes all tasks.
+*/
+void init_scheduler(void);
+
+/* add_task()
+** - register a task. The task will first run "phase" milliseconds
+** from now and then every "period" milliseconds after that. A period
+** of 0 makes a one-shot task which is removed after it has run once.
+** Returns the task ID (used by the functions below), or NO_TASK if
+** MAX_TASKS tasks are already registered.
+*/
+uint8_t add_task(void (*function)(void), uint16_t period, uint16_t phase);
+
+/* remove_task()
+** - remove a task. A task may remove itself.
+*/
+void remove_task(uint8_t taskId);
+
+/* set_task_period()
+** - change the period of a task. Takes effect from the next time the
+** task runs.
+*/
+void set_task_period(uint8_t taskId, uint16_t period);
+
+/* suspend_task() / resume_task()
+** - a suspended task is not run until it is resumed. When resumed, a
+** task next runs one period later (or straight away if one-shot).
+*/
+void suspend_task(uint8_t taskId);
+void resume_task(uint8_t taskId);
+
+/* get_task_overruns()
+** - returns the number of times the task was so late that one or more
+** of its periods were missed altogether. (A late periodic task is
+** rescheduled from the time it actually ran - missed runs are skipped
+** rather than made up.)
+*/
+uint16_t get_task_overruns(uint8_t taskId);
+
+/* run_due_tasks()
+** - run every task whose deadline has been reached. Should be called
+** from the main event loop. Returns the number of tasks run.
+*/
+uint8_t run_due_tasks(void);
+
+/* next_task_deadline()
+** - returns the deadline (clock tick value) of the next task due to
+** run. If no tasks are waiting, a time far in the future is returned.
+** The main event loop can sleep until this time - see sleep_until()
+** in timer2.h.
+*/
+uint32_t next_task_deadline(void);
+
+#endif
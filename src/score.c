@@ -5,8 +5,10 @@
 */
 
 #include <stdint.h>
+#include "hal.h"
 
-uint16_t score;
+/* Each thread of the host simulator has its own score (see hal.h) */
+HAL_THREAD_LOCAL uint16_t score;
 
 void init_score(void) {
 	score = 0;
@@ -24,3 +26,7 @@ void add_to_score(uint16_t value) {
 uint16_t get_score(void) {
 	return score;
 }
+
+void set_score(uint16_t value) {
+	score = value;
+}
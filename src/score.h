@@ -9,4 +9,5 @@
 void init_score(void);
 void add_to_score(uint16_t value);
 uint16_t get_score(void);
+void set_score(uint16_t value);
 
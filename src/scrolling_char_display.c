@@ -22,7 +22,8 @@
 */
 
 #include "led_display.h"
-#include <avr/pgmspace.h>
+#include "hal.h"
+#include "atomic_section.h"
 
 
 /* FONT DEFINITION
@@ -216,10 +217,15 @@ uint8_t scroll_display(void)
 	** All the other bits are shifted to the right (which because bit 0 is
 	** displayed on the left, means the display moves one position to
 	** the left).
+	** Interrupts are turned off while we do this since the display
+	** is drawn from an interrupt handler (see timer2.c) and we don't
+	** want a half-updated row to be shown.
 	*/
-	for(i=0; i<NUM_ROWS; i++) {
-		display[i] = (display[i] >> 1) | ((col_data << (i+NUM_ROWS))&0x4000);
-		finished = finished && (display[i] == 0);
+	ATOMIC_SECTION(ATOMIC_SCROLL_DISPLAY) {
+		for(i=0; i<NUM_ROWS; i++) {
+			display[i] = (display[i] >> 1) | ((col_data << (i+NUM_ROWS))&0x4000);
+			finished = finished && (display[i] == 0);
+		}
 	}
 	return !finished;
 }
@@ -3,7 +3,7 @@
 **
 */
 
-#include <avr/pgmspace.h>
+#include "hal.h"
 
 void set_display_text(char* string);
 	/* Sets the text to be displayed. The message will 
@@ -1,36 +1,213 @@
 #include <stdlib.h>
-#include <avr/interrupt.h>
+#include "hal.h"
 #include "game.h"
 #include "project.h"
+#include "sfx.h"
+#include "atomic_section.h"
+#ifdef SFX_DDS
+#include "dds.h"
+#endif
+
+/* If SFX_DDS is defined, notes are played by the DDS synthesiser
+** (see dds.h) on its first voice, with the speaker on PB5, instead
+** of by timer 3. Any other DDS voices are left for other uses.
+*/
+#define DDS_SFX_VOICE 0
+#define DDS_SFX_WAVEFORM DDS_WAVE_TRIANGLE
+
+#ifndef SFX_DDS
+/* Output compare values for each note. Timer 3 divides the 8MHz
+** clock by 8 and toggles OC3A each time it reaches the compare value
+** (then restarts from 0), so the frequency of the note is
+**		f = 8000000 / (2 * 8 * (OCR3A + 1))
+** i.e. OCR3A = 500000 / f - 1 (rounded).
+*/
+static const uint16_t noteCompareValues[NUM_NOTES] PROGMEM = {
+	1910, 1803, 1702, 1606, 1516, 1431,	/* C4 CS4 D4 DS4 E4 F4 */
+	1350, 1275, 1203, 1135, 1072, 1011,	/* FS4 G4 GS4 A4 AS4 B4 */
+	955, 901, 850, 803, 757, 715,		/* C5 CS5 D5 DS5 E5 F5 */
+	675, 637, 601, 567, 535, 505,		/* FS5 G5 GS5 A5 AS5 B5 */
+	477, 450, 425, 401, 378, 357,		/* C6 CS6 D6 DS6 E6 F6 */
+	337, 318, 300, 283, 267, 252		/* FS6 G6 GS6 A6 AS6 B6 */
+};
+#endif
+
+/* Sound effect tracks. Each step of a track is a note (or REST)
+** and the number of 2ms ticks it lasts (up to 255 - use MS() to
+** convert from milliseconds). A track ends with an END step.
+*/
+#define REST 0xFE
+#define END 0xFF
+#define MS(ms) ((ms) / 2)
+
+typedef struct {
+	uint8_t note;
+	uint8_t ticks;
+} SfxStep;
+
+static const SfxStep fireTrack[] PROGMEM = {
+	{ NOTE_E6, MS(20) }, { NOTE_A6, MS(20) }, { END, 0 }
+};
+static const SfxStep hitTrack[] PROGMEM = {
+	{ NOTE_C6, MS(30) }, { NOTE_G5, MS(30) }, { NOTE_C5, MS(40) },
+	{ END, 0 }
+};
+static const SfxStep levelUpTrack[] PROGMEM = {
+	{ NOTE_C5, MS(60) }, { NOTE_E5, MS(60) }, { NOTE_G5, MS(60) },
+	{ NOTE_C6, MS(120) }, { END, 0 }
+};
+static const SfxStep baseDamageTrack[] PROGMEM = {
+	{ NOTE_D4, MS(60) }, { REST, MS(20) }, { NOTE_C4, MS(100) },
+	{ END, 0 }
+};
+static const SfxStep gameOverTrack[] PROGMEM = {
+	{ NOTE_G4, MS(200) }, { REST, MS(40) }, { NOTE_E4, MS(200) },
+	{ REST, MS(40) }, { NOTE_C4, MS(500) }, { END, 0 }
+};
+
+/* Track for each effect (indexed by SFX_FIRE etc.) */
+static const SfxStep* const effectTracks[NUM_SFX] PROGMEM = {
+	0, fireTrack, hitTrack, levelUpTrack, baseDamageTrack, gameOverTrack
+};
+
+/* Sequencer state. pendingEffect is the highest priority effect
+** requested since the last tick (SFX_NONE if none). playingEffect
+** is the effect being played, nextStep points to its next step in
+** flash and stepTicksLeft is the number of ticks until that step
+** is due.
+*/
+static volatile uint8_t pendingEffect;
+static uint8_t playingEffect;
+static const SfxStep* nextStep;
+static uint8_t stepTicksLeft;
+
+/* Private functions - only used within this module */
+static void start_step(void);
+
+/* Time left (in milliseconds) for the note that is playing.
+** 0 if no note is playing or the note plays until stopped.
+*/
+static volatile uint16_t toneTimeLeft;
 
 void init_sfx(void) {
 	
-	/*Setup JE*/
+#ifdef SFX_DDS
+	init_dds();
+#else
+	/* Speaker is on PE3 (OC3A) */
+	DDRE |= (1<<3);
+
+	//Setup Timer 3 - clear on compare match (CTC mode). The
+	//timer is stopped (no clock source) until a note is played.
+	TCCR3A = 0x00;
+	TCCR3B = (1<<WGM32);
+#endif
+
+	toneTimeLeft = 0;
+	pendingEffect = SFX_NONE;
+	playingEffect = SFX_NONE;
+}
+
+void play_tone(uint8_t note, uint16_t durationMs) {
+	if(note >= NUM_NOTES) {
+		return;
+	}
+
+	/* Set the compare value for this note and restart the
+	** timer, with OC3A toggled on each compare match and the
+	** clock divided by 8.
+	** Interrupts are turned off so that sfx_tick() can't stop
+	** the note while we are part way through starting it.
+	*/
+	ATOMIC_SECTION(ATOMIC_PLAY_TONE) {
+#ifdef SFX_DDS
+		dds_note_on(DDS_SFX_VOICE, note, DDS_SFX_WAVEFORM);
+#else
+		OCR3A = pgm_read_word(&noteCompareValues[note]);
+		TCNT3 = 0;
+		TCCR3A = (1<<COM3A0);
+		TCCR3B = (1<<WGM32)|(1<<CS31);
+#endif
+		toneTimeLeft = durationMs;
+	}
+}
+
+void stop_tone(void) {
+#ifdef SFX_DDS
+	dds_note_off(DDS_SFX_VOICE);
+#else
+	/* Disconnect OC3A from the pin and stop the timer. (The
+	** pin is then driven by PORTE - bit 3 is left at 0.)
+	*/
+	TCCR3A = 0x00;
+	TCCR3B = (1<<WGM32);
+#endif
+	toneTimeLeft = 0;
+}
+
+void sfx_trigger(uint8_t effect) {
+	/* A single byte is read and written, so there is no need to
+	** turn interrupts off. (If sfx_tick() takes the pending effect
+	** in between, we just request ours anyway.)
+	*/
+	if(effect > pendingEffect && effect < NUM_SFX) {
+		pendingEffect = effect;
+	}
+}
 
-	/*
-		PD6
-		PB5
-		PD4
-		PB6
+void sfx_tick(void) {
+	uint8_t effect = pendingEffect;
 
+	/* Start a newly requested effect - unless a higher priority
+	** one is playing.
 	*/
-	DDRD |= (1<<6);
-	DDRB |= (1<<5); 
-	DDRD |= (1<<4);
-	DDRB |= (1<<6);
+	if(effect != SFX_NONE) {
+		pendingEffect = SFX_NONE;
+		if(effect >= playingEffect) {
+			playingEffect = effect;
+			nextStep = (const SfxStep*)pgm_read_word(&effectTracks[effect]);
+			start_step();
+			return;
+		}
+	}
 
-	//Setup Timer
-	OCR1C = 1;
-    TCCR3A = 0x00; 
-    TCCR3B = 0xA;
+	if(playingEffect != SFX_NONE) {
+		if(--stepTicksLeft == 0) {
+			start_step();
+		}
+		return;
+	}
 
+	/* No effect playing - time the note started by play_tone() */
+	if(toneTimeLeft == 0) {
+		return;
+	}
+	if(toneTimeLeft <= 2) {
+		stop_tone();
+	} else {
+		toneTimeLeft -= 2;
+	}
 }
 
-ISR(TIMER3_COMPA_vect) {
+/****************** INTERNAL FUNCTIONS *********************/
 
-	PORTD = PORTD ^ (1<<6);
-	PORTB = PORTB ^ (1<<5); 
-	PORTD = PORTD ^ (1<<4);
-	PORTB = PORTB ^ (1<<6);
+/* start_step()
+**  - start playing the next step of the effect being played, or
+**    stop if the end of its track has been reached.
+*/
+static void start_step(void) {
+	uint8_t note = pgm_read_byte(&nextStep->note);
 
+	if(note == END) {
+		stop_tone();
+		playingEffect = SFX_NONE;
+		return;
+	}
+	stepTicksLeft = pgm_read_byte(&nextStep->ticks);
+	if(note == REST) {
+		stop_tone();
+	} else {
+		play_tone(note, 0);
+	}
+	nextStep++;
 }
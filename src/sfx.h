@@ -1,8 +1,75 @@
 /*
 **	sfx.h
+**
+**	Sound effects. Tones are generated by timer 3 in hardware
+**	(the OC3A output, pin PE3, toggles on each compare match)
+**	so no CPU time is used while a note plays. If SFX_DDS is
+**	defined when compiling, notes are instead played by the DDS
+**	synthesiser (see dds.h) on PB5.
+**
+**	Short sound effects (sequences of notes stored in flash) are
+**	started with sfx_trigger() and played in the background by
+**	sfx_tick().
  */
 
+#ifndef SFX_H
+#define SFX_H
+
 #include <inttypes.h>
 
+/* Notes that can be played - from C4 (middle C) to B6. The
+** frequency of each is given by a table in flash (see sfx.c).
+*/
+enum {
+	NOTE_C4, NOTE_CS4, NOTE_D4, NOTE_DS4, NOTE_E4, NOTE_F4,
+	NOTE_FS4, NOTE_G4, NOTE_GS4, NOTE_A4, NOTE_AS4, NOTE_B4,
+	NOTE_C5, NOTE_CS5, NOTE_D5, NOTE_DS5, NOTE_E5, NOTE_F5,
+	NOTE_FS5, NOTE_G5, NOTE_GS5, NOTE_A5, NOTE_AS5, NOTE_B5,
+	NOTE_C6, NOTE_CS6, NOTE_D6, NOTE_DS6, NOTE_E6, NOTE_F6,
+	NOTE_FS6, NOTE_G6, NOTE_GS6, NOTE_A6, NOTE_AS6, NOTE_B6,
+	NUM_NOTES
+};
+
+/* Sound effects, in order of priority (lowest first). An effect
+** will interrupt one of the same or lower priority that is playing,
+** but is dropped if a higher priority effect is playing.
+*/
+enum {
+	SFX_NONE,
+	SFX_FIRE,
+	SFX_HIT,
+	SFX_LEVEL_UP,
+	SFX_BASE_DAMAGE,
+	SFX_GAME_OVER,
+	NUM_SFX
+};
+
 void init_sfx(void);
 void init_sseg_score_display(void);
+
+/* Start playing the given note (NOTE_C4 etc.) for the given
+** number of milliseconds (to the nearest 2ms). Replaces any note
+** already playing (but a sound effect started later will take
+** over the speaker). A duration of 0 plays until stop_tone() is called.
+** Returns immediately.
+*/
+void play_tone(uint8_t note, uint16_t durationMs);
+
+/* Stop the note currently playing (if any) */
+void stop_tone(void);
+
+/* Request that the given sound effect (SFX_FIRE etc.) be played.
+** This just records the request - the effect is started by the
+** next sfx_tick() - so it returns straight away and is cheap enough
+** to call from anywhere in the game logic. If several effects are
+** requested before then, the highest priority one is played.
+*/
+void sfx_trigger(uint8_t effect);
+
+/* Called every 2ms from the timer 2 interrupt handler (see
+** timer2.c) to stop notes when their time is up and to step
+** through the notes of the sound effect being played.
+*/
+void sfx_tick(void);
+
+#endif
@@ -0,0 +1,222 @@
+/*
+** spi.c
+**
+** Shared SPI bus manager - see spi.h.
+**
+** Transactions wait in a small circular queue. The transaction at
+** the front of the queue is started by taking its chip select line
+** low. Each byte is then written to SPDR and the SPI interrupt
+** (which fires when the byte has been shifted out and in) stores
+** the received byte and starts the next one. If the transaction
+** needs a delay between bytes, timer 0 is started instead and its
+** output compare interrupt starts the next byte. When the last byte
+** is complete the chip select line is taken high, the callback is
+** called and the next transaction in the queue is started.
+*/
+
+#include "hal.h"
+#include "spi.h"
+#include "profile.h"
+#include "isr_latency.h"
+#include "atomic_section.h"
+#include "trace.h"
+
+/* Queue of transactions waiting for the bus. queueHead is the index
+** of the next transaction to start; queueCount is the number waiting.
+*/
+static SpiTransaction* volatile queue[SPI_QUEUE_SIZE];
+static volatile uint8_t queueHead;
+static volatile uint8_t queueCount;
+
+/* The transaction in progress (0 if the bus is free) and the index
+** of the byte currently being transferred.
+*/
+static SpiTransaction* volatile current;
+static volatile uint8_t byteIndex;
+
+/* Private functions - only used within this module. These must
+** be called with interrupts disabled (or from an interrupt handler).
+*/
+static void start_next_transaction(void);
+static void start_byte(void);
+static void start_delay(uint8_t microseconds);
+
+/* See comment in .h file */
+void init_spi(void)
+{
+	/* Set data direction register appropriately. The following
+	** bits are configured to be outputs:
+	** SS, MOSI, SCK (i.e. PB0, PB2, PB1)
+	** SS must be an output for the SPI port to remain a master,
+	** even if no device uses it as its chip select.
+	*/
+	DDRB |= 0x07;
+
+	/* Take the slave select line high */
+	PORTB |= 0x01;
+
+	/* Enable the SPI port as a master, with the SPI interrupt
+	** enabled. The mode and clock rate are set at the start of
+	** each transaction.
+	*/
+	SPCR = (1<<SPIE)|(1<<SPE)|(1<<MSTR);
+
+	/* Timer 0 is used for the delays between bytes. We set it to
+	** clear on compare match (CTC mode) and enable the output
+	** compare interrupt. The timer is stopped (no clock source)
+	** until a delay is needed.
+	*/
+	TCCR0 = (1<<WGM01);
+	TIMSK |= (1<<OCIE0);
+
+	queueHead = 0;
+	queueCount = 0;
+	current = 0;
+}
+
+/* See comment in .h file */
+uint8_t spi_submit(SpiTransaction* transaction)
+{
+	uint8_t queued = 0;
+
+	/* The queue is shared with the interrupt handlers, so we
+	** disable interrupts while we change it.
+	*/
+	ATOMIC_SECTION(ATOMIC_SPI_SUBMIT) {
+		if(queueCount < SPI_QUEUE_SIZE && !spi_pending(transaction)) {
+			transaction->status = SPI_QUEUED;
+			queue[(queueHead + queueCount) % SPI_QUEUE_SIZE] = transaction;
+			queueCount++;
+			if(!current) {
+				/* Bus is free - start straight away */
+				start_next_transaction();
+			}
+			queued = 1;
+		}
+	}
+	return queued;
+}
+
+/* See comment in .h file */
+uint8_t spi_pending(SpiTransaction* transaction)
+{
+	return transaction->status == SPI_QUEUED ||
+			transaction->status == SPI_BUSY;
+}
+
+/****************** INTERNAL FUNCTIONS *********************/
+
+/* start_next_transaction()
+**  - take the transaction at the front of the queue, set the SPI
+**    mode and clock rate it needs and select the device.
+*/
+static void start_next_transaction(void)
+{
+	SpiTransaction* t;
+
+	if(queueCount == 0) {
+		current = 0;
+		return;
+	}
+	t = queue[queueHead];
+	queueHead = (queueHead + 1) % SPI_QUEUE_SIZE;
+	queueCount--;
+
+	current = t;
+	byteIndex = 0;
+	t->status = SPI_BUSY;
+
+	/* Mode bits (CPOL, CPHA) are bits 3 and 2 of SPCR; the clock
+	** rate is given by SPR1, SPR0 (bits 1 and 0) and SPI2X.
+	*/
+	SPCR = (1<<SPIE)|(1<<SPE)|(1<<MSTR)|((t->mode & 0x03)<<CPHA)|
+			(t->clock & 0x03);
+	SPSR = (t->clock & 0x04) ? (1<<SPI2X) : 0;
+
+	/* Take the chip select line low */
+	*(t->csPort) &= ~(t->csMask);
+
+	if(t->byteDelay) {
+		start_delay(t->byteDelay);
+	} else {
+		start_byte();
+	}
+}
+
+/* start_byte()
+**  - write the next byte of the current transaction to SPDR. This
+**    starts the transfer - the SPI interrupt fires when it is done.
+**    If all bytes have been transferred, the transaction is finished
+**    instead and the next one started.
+*/
+static void start_byte(void)
+{
+	SpiTransaction* t = current;
+
+	if(byteIndex >= t->length) {
+		/* Transaction complete - take the chip select line high
+		** and let the device driver know.
+		*/
+		*(t->csPort) |= t->csMask;
+		t->status = SPI_DONE;
+		if(t->callback) {
+			t->callback(t);
+		}
+		start_next_transaction();
+		return;
+	}
+	hal_spi_write(t->txBuffer ? t->txBuffer[byteIndex] : 0);
+}
+
+/* start_delay()
+**  - start timer 0 so that its output compare interrupt fires after
+**    the given number of microseconds. With an 8MHz clock divided by
+**    8 the timer counts every microsecond. (The timer 0 prescaler is
+**    free running, so the first count may come up to 1 microsecond
+**    early - we count to the delay value rather than delay - 1 so the
+**    delay is never shorter than requested.)
+*/
+static void start_delay(uint8_t microseconds)
+{
+	TCNT0 = 0;
+	OCR0 = microseconds;
+	hal_clear_timer_flags(1<<OCF0);
+	TCCR0 = (1<<WGM01)|(1<<CS01);
+}
+
+/* SPI transfer complete - store the byte received and move on to
+** the next byte (possibly after a delay) or the next transaction.
+*/
+ISR(SPI_STC_vect)
+{
+	PROFILE_BEGIN(PROF_SPI_ISR);
+	TRACE_BEGIN(TRACE_SPI_ISR);
+	SpiTransaction* t = current;
+
+	if(t->rxBuffer) {
+		t->rxBuffer[byteIndex] = SPDR;
+	}
+	byteIndex++;
+
+	/* No delay is needed after the last byte */
+	if(byteIndex < t->length && t->byteDelay) {
+		start_delay(t->byteDelay);
+	} else {
+		start_byte();
+	}
+	TRACE_END(TRACE_SPI_ISR);
+	PROFILE_END(PROF_SPI_ISR);
+}
+
+/* Delay between bytes has elapsed - stop the timer and send the
+** next byte.
+*/
+ISR(TIMER0_COMP_vect)
+{
+	/* Timer 0 restarted from 0 at the compare match and counts
+	** every 8 cycles.
+	*/
+	ISR_LATENCY_RECORD(LATENCY_SPI_DELAY, (uint16_t)TCNT0 * 8);
+	TCCR0 = (1<<WGM01);
+	start_byte();
+}
@@ -0,0 +1,103 @@
+/*
+** spi.h
+**
+** Shared SPI bus manager. Each device on the SPI bus (Joystick PMOD,
+** SPI flash etc.) describes an exchange with a transaction descriptor
+** and hands it to spi_submit(). Transactions are queued and executed
+** one after the other entirely from the SPI interrupt, so application
+** code never waits for the bus.
+**
+** The bus uses the AVR SPI port (PB0 to PB3) in master mode. Timer 0
+** is used to time the delays between bytes and must not be used by
+** other modules.
+*/
+
+#ifndef SPI_H
+#define SPI_H
+
+#include <stdint.h>
+
+/* Maximum number of transactions that can be waiting for the bus
+** (not including the transaction in progress).
+*/
+#define SPI_QUEUE_SIZE 4
+
+/* SPI modes (clock polarity and phase) - see page 167 of the
+** ATmega64 datasheet.
+*/
+#define SPI_MODE0 0
+#define SPI_MODE1 1
+#define SPI_MODE2 2
+#define SPI_MODE3 3
+
+/* SPI clock rates. The lower two bits are the SPR1,SPR0 bits of
+** SPCR; bit 2 is the SPI2X bit of SPSR.
+*/
+#define SPI_CLOCK_DIV4 0x00
+#define SPI_CLOCK_DIV16 0x01
+#define SPI_CLOCK_DIV64 0x02
+#define SPI_CLOCK_DIV128 0x03
+#define SPI_CLOCK_DIV2 0x04
+#define SPI_CLOCK_DIV8 0x05
+#define SPI_CLOCK_DIV32 0x06
+
+/* Values of the status member of a transaction */
+#define SPI_IDLE 0		/* never submitted */
+#define SPI_QUEUED 1	/* waiting for the bus */
+#define SPI_BUSY 2		/* in progress */
+#define SPI_DONE 3		/* complete - rxBuffer holds the result */
+
+/* Transaction descriptor. The descriptor (and its buffers) belong to
+** the device driver and must not be changed while the transaction is
+** queued or in progress.
+**
+** csPort, csMask - port register and bit mask of the (active low)
+**		chip select line for the device. The line must already be
+**		configured as an output and be high.
+** mode - SPI_MODE0 to SPI_MODE3
+** clock - one of the SPI_CLOCK_DIVx values above
+** txBuffer - the bytes to send. If 0, zeros are sent.
+** rxBuffer - where the bytes received are stored. If 0, they are
+**		discarded.
+** length - number of bytes to transfer
+** byteDelay - delay (in microseconds) after the chip select line
+**		is taken low and between each byte. 0 means no delay.
+** callback - function called (from the SPI interrupt handler) when
+**		the transaction is complete. May be 0. Must be short.
+** status - one of SPI_IDLE etc. above. Maintained by this module.
+*/
+typedef struct spi_transaction {
+	volatile uint8_t* csPort;
+	uint8_t csMask;
+	uint8_t mode;
+	uint8_t clock;
+	const uint8_t* txBuffer;
+	uint8_t* rxBuffer;
+	uint8_t length;
+	uint8_t byteDelay;
+	void (*callback)(struct spi_transaction*);
+	volatile uint8_t status;
+} SpiTransaction;
+
+/* init_spi()
+** - must be called before any device uses the bus (and before
+** interrupts are enabled). Sets up the SPI port as a master and
+** the data direction registers for SS, SCK and MOSI.
+*/
+void init_spi(void);
+
+/* spi_submit()
+** - add a transaction to the queue. The transaction starts as soon
+** as the bus is free. Returns 1 if the transaction was queued, 0 if
+** the queue is full or the transaction is already queued or in
+** progress. Never waits.
+*/
+uint8_t spi_submit(SpiTransaction* transaction);
+
+/* spi_pending()
+** - returns 1 if the given transaction is queued or in progress,
+** 0 otherwise.
+*/
+uint8_t spi_pending(SpiTransaction* transaction);
+
+#endif
@@ -1,5 +1,5 @@
 #include <stdlib.h>
-#include <avr/interrupt.h>
+#include "hal.h"
 #include "game.h"
 #include "sseg_display.h"
 #include "score.h"
@@ -15,23 +15,15 @@ void init_sseg_score_display(void) {
 	
 	//PORTF = 0xFF;
 
-	//Setup Timer
-	OCR1A = 9999; 
-    TCCR1A = 0x00; 
-    TCCR1B = 0xA;
-
-	//Enable interrupt on timer on output compare match  
-	 
-    TIMSK |= (1 << 4); 
- 
-    /* Ensure interrupt flag is cleared */ 
-    TIFR |= (1 << 4);
+	/* The digits are multiplexed by sseg_display_next_digit(),
+	** which is run every 10ms from the timer 2 interrupt handler.
+	*/
 
 }
 
 
 
-ISR(TIMER1_COMPA_vect) {
+void sseg_display_next_digit(void) {
 
 	
 	int show;
@@ -62,15 +54,4 @@ ISR(TIMER1_COMPA_vect) {
     seven_seg_cat ^= (1 << 0);			
 
 	show_high_score = 0;
-	
-
-	//Reset Score and Add 1 Health;
-
-	if (get_score() == 100) {
-		if (getHealth < 4) {
-			setHealth(getHealth()+1);
-			outputHealth();
-		}
-	}
-
 }
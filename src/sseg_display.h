@@ -6,3 +6,9 @@
 
 
 void init_sseg_score_display(void);
+
+/* Show the next digit of the score (or high score) - each
+** digit is shown in turn. Called every 10ms from the timer 2
+** interrupt handler (see timer2.c).
+*/
+void sseg_display_next_digit(void);
@@ -0,0 +1,83 @@
+/*
+** stack_monitor.c
+**
+** Stack and RAM usage monitoring - see stack_monitor.h.
+**
+** _end (the end of .bss and .noinit), __heap_start, __brkval and
+** __stack are provided by the linker and avr-libc.
+*/
+
+#include "hal.h"
+#include "stack_monitor.h"
+
+extern uint8_t _end;
+extern uint8_t __stack;
+extern uint8_t __heap_start;
+extern char* __brkval;
+
+static uint8_t faultFound = 0;
+
+/* Fill the unused RAM with STACK_CANARY. This is placed in the
+** .init1 section so it runs as part of the start up code, before
+** the stack is in use and before the registers are set up - so it
+** is written in assembler and uses no stack.
+*/
+void stack_paint(void) __attribute__((naked, used, section(".init1")));
+
+void stack_paint(void)
+{
+	asm volatile(
+		"	ldi r30, lo8(_end)"		"\n"
+		"	ldi r31, hi8(_end)"		"\n"
+		"	ldi r24, %0"			"\n"
+		"	ldi r25, hi8(__stack)"	"\n"
+		"	rjmp 2f"				"\n"
+		"1:	st Z+, r24"				"\n"
+		"2:	cpi r30, lo8(__stack)"	"\n"
+		"	cpc r31, r25"			"\n"
+		"	brlo 1b"				"\n"
+		"	breq 1b"				"\n"
+		: : "i" (STACK_CANARY)
+	);
+}
+
+/* See comment in .h file */
+uint16_t stack_unused(void)
+{
+	const uint8_t* p = &_end;
+	uint16_t count = 0;
+
+	while(p <= &__stack && *p == STACK_CANARY) {
+		p++;
+		count++;
+	}
+	return count;
+}
+
+/* See comment in .h file */
+uint16_t stack_free_ram(void)
+{
+	uint8_t* heapEnd = __brkval ? (uint8_t*)__brkval : &__heap_start;
+
+	return (uint8_t*)SP - heapEnd;
+}
+
+/* See comment in .h file */
+uint8_t stack_check(void)
+{
+	const uint8_t* p;
+
+	for(p = &_end; p < &_end + STACK_GUARD_BYTES; p++) {
+		if(*p != STACK_CANARY) {
+			faultFound = 1;
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* See comment in .h file */
+uint8_t stack_fault(void)
+{
+	return faultFound;
+}
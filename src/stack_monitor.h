@@ -0,0 +1,50 @@
+/*
+** stack_monitor.h
+**
+** Stack and RAM usage monitoring. At start up (before main() runs)
+** all the RAM between the end of the global variables and the top
+** of the stack is filled with a known value (STACK_CANARY). As the
+** stack grows down into this area it overwrites the value, so by
+** looking for the lowest byte that has changed we know the most
+** stack that has ever been used.
+**
+** The STACK_GUARD_BYTES bytes just above the global variables are a
+** guard zone. If the stack ever reaches them it is about to
+** overwrite (or has overwritten) global variables - stack_check()
+** detects this.
+*/
+
+#ifndef STACK_MONITOR_H
+#define STACK_MONITOR_H
+
+#include <stdint.h>
+
+#define STACK_CANARY 0xC5
+#define STACK_GUARD_BYTES 16
+
+/* stack_unused()
+** - returns the number of bytes of RAM (between the global variables
+** and the stack) that the stack has never used since reset - i.e.
+** how close the stack has come to the global variables.
+*/
+uint16_t stack_unused(void);
+
+/* stack_free_ram()
+** - returns the number of bytes of RAM currently free between the
+** global variables (and heap, if used) and the stack pointer.
+*/
+uint16_t stack_free_ram(void);
+
+/* stack_check()
+** - checks the guard zone. Returns 1 if it is intact, 0 if the stack
+** has reached it. Once it has failed, stack_fault() returns 1.
+*/
+uint8_t stack_check(void);
+
+/* stack_fault()
+** - returns 1 if stack_check() has ever found the guard zone
+** damaged.
+*/
+uint8_t stack_fault(void);
+
+#endif
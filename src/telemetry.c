@@ -0,0 +1,75 @@
+/*
+** telemetry.c
+**
+** Periodic telemetry records - see telemetry.h.
+*/
+
+#include "telemetry.h"
+#include "uart.h"
+#include "scheduler.h"
+#include "timer2.h"
+#include "watchdog.h"
+#include "game.h"
+#include "score.h"
+#include "project.h"
+
+/* Counts for the current period */
+static uint16_t loopCount;
+static uint16_t frameCount;
+
+/* Private functions - only used within this module */
+static void telemetry_task(void);
+
+/* See comment in .h file */
+void init_telemetry(void)
+{
+	loopCount = 0;
+	frameCount = 0;
+	reset_energy_counters();
+	add_task(telemetry_task, TELEMETRY_PERIOD_MS, TELEMETRY_PERIOD_MS);
+}
+
+/* See comment in .h file */
+void telemetry_count_loop(void)
+{
+	loopCount++;
+}
+
+/* See comment in .h file */
+void telemetry_count_frame(void)
+{
+	frameCount++;
+}
+
+/****************** INTERNAL FUNCTIONS *********************/
+
+/* telemetry_task()
+**  - send a record and start a new period.
+*/
+static void telemetry_task(void)
+{
+	TelemetryRecord record;
+	uint32_t maxLoopMicros;
+	uint8_t maxLoopTask;
+
+	watchdog_get_stall_stats(&maxLoopMicros, &maxLoopTask);
+
+	record.timestamp = get_clock_ticks();
+	record.loops = loopCount;
+	record.frames = frameCount;
+	record.maxLoopMicros = (maxLoopMicros > 0xFFFF) ? 0xFFFF : maxLoopMicros;
+	record.activePermille = get_active_permille();
+	record.score = get_score();
+	record.health = getHealth();
+	record.asteroids = numAsteroids;
+	record.projectiles = numProjectiles;
+	record.droppedLogicSteps = dropped_logic_steps;
+	record.droppedFrames = uart_get_dropped_frames();
+
+	/* (A dropped record is counted by the serial port) */
+	uart_send_frame(FRAME_TELEMETRY, &record, sizeof(record));
+
+	loopCount = 0;
+	frameCount = 0;
+	reset_energy_counters();
+}
@@ -0,0 +1,47 @@
+/*
+** telemetry.h
+**
+** Sends a telemetry record (see TelemetryRecord below) over the
+** serial port (see uart.h) every TELEMETRY_PERIOD_MS milliseconds.
+** Records are sent in FRAME_TELEMETRY frames. If the serial buffer is
+** full the record is dropped and counted - we never wait.
+*/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+#define TELEMETRY_PERIOD_MS 1000
+
+/* Payload of a FRAME_TELEMETRY frame. Multi-byte values are little
+** endian. Rates and counts are for the last period.
+*/
+typedef struct {
+	uint32_t timestamp;			/* clock ticks (ms) */
+	uint16_t loops;				/* main event loop iterations */
+	uint16_t frames;			/* display updates */
+	uint16_t maxLoopMicros;		/* longest loop since start (65535 max) */
+	uint16_t activePermille;	/* CPU time not asleep (parts per 1000) */
+	uint16_t score;
+	int8_t health;
+	uint8_t asteroids;
+	uint8_t projectiles;
+	uint16_t droppedLogicSteps;	/* since start */
+	uint16_t droppedFrames;		/* serial frames dropped since start */
+} TelemetryRecord;
+
+/* init_telemetry()
+** - starts sending telemetry. The serial port and the scheduler
+** must already be initialised.
+*/
+void init_telemetry(void);
+
+/* telemetry_count_loop() / telemetry_count_frame()
+** - called once for each iteration of the main event loop and each
+** time the display is updated.
+*/
+void telemetry_count_loop(void);
+void telemetry_count_frame(void);
+
+#endif
@@ -5,35 +5,126 @@
 ** We setup timer2 to generate an interrupt every 1ms
 ** We update a global clock tick variable - whose value
 ** can be retrieved using the get_clock_ticks() function.
+**
+** In tickless mode, sleep_until() can stretch the current
+** timer period to 2ms when nothing is due before then, so
+** the interrupt (and the wake up from sleep) is skipped.
+** The clock tick count remains accurate since the timer
+** count (TCNT2) tells us how far into the period we are.
+**
+** The timer interrupt is also our tick dispatcher: regular
+** jobs that must run with little jitter (display multiplexing)
+** are run from the interrupt handler, from the tickTasks table
+** below. Timer 1 (previously used for the seven segment display)
+** is therefore free for other uses, e.g. hardware PWM.
+*/
+
+
+#include "hal.h"
+#include "timer2.h"
+#include "led_display.h"
+#include "sseg_display.h"
+#include "sfx.h"
+#include "profile.h"
+#include "isr_latency.h"
+#include "trace.h"
+
+/* Number of timer counts in one clock tick (1 millisecond) */
+#define COUNTS_PER_TICK 125
+
+/* Longest timer period we can use in tickless mode. The timer
+** is 8 bits, so this is 2 ticks (250 counts).
 */
+#define MAX_TICKS_PER_PERIOD 2
 
+/* Our internal clock tick count - incremented every
+** millisecond. Will overflow every ~49 days.
+** In tickless mode this is the tick count at the start
+** of the current timer period.
+*/
+volatile uint32_t clockTicks;
+
+/* Number of ticks in the current timer period (1, or 2 if
+** the period has been stretched by sleep_until()).
+*/
+volatile uint8_t ticksThisPeriod;
+
+/* Is tickless mode enabled? */
+static uint8_t tickless;
+
+/* Jobs run from the timer interrupt handler. Each is run every
+** "period" ticks (which must be at least MAX_TICKS_PER_PERIOD)
+** and should take no more than "budget" CPU cycles. The table is
+** in priority order - after the clock tick count is updated, jobs
+** that are due are run in the order they appear here.
+*/
+typedef struct {
+	void (*function)(void);
+	uint8_t period;		/* ticks */
+	uint16_t budget;	/* CPU cycles */
+} TickTask;
 
-#include <avr/io.h>
-#include <avr/interrupt.h>
+#define NUM_TICK_TASKS 3
 
-/* Our internal clock tick count - incremented every 
-** millisecond. Will overflow every ~49 days. */
-static volatile uint32_t clockTicks;
+static const TickTask tickTasks[NUM_TICK_TASKS] = {
+	/* Show the next row of the LED display every 2ms */
+	{ display_row, 2, 128 },
+	/* Show the next seven segment display digit every 10ms */
+	{ sseg_display_next_digit, 10, 384 },
+	/* Stop sound effect notes when their time is up */
+	{ sfx_tick, 2, 128 }
+};
 
-/* Set up timer 2 to generate an interrupt every 1ms. 
+/* Number of ticks until each job is next due (counted from the
+** start of the current timer period), and for each job the
+** longest time it has taken (in timer counts) and the number
+** of times it has gone over its budget.
+*/
+static uint8_t tickCountdown[NUM_TICK_TASKS];
+static uint8_t tickMaxCounts[NUM_TICK_TASKS];
+static uint16_t tickOverruns[NUM_TICK_TASKS];
+
+/* Energy counters - time spent asleep and the time at which
+** the counters were reset, in timer counts (8 microseconds).
+*/
+static uint32_t sleepCounts;
+static uint32_t countersResetTime;
+
+/* Private functions - only used within this module */
+static void read_clock(uint32_t* ticks, uint8_t* counts);
+static uint32_t get_timer_counts(void);
+static uint8_t ticks_until_tick_task(void);
+
+/* Set up timer 2 to generate an interrupt every 1ms.
 ** We will divide the clock by 64 and count up to 124.
 ** We will therefore get an interrupt every 64 x 125
 ** clock cycles, i.e. every 1 milliseconds with an 8MHz
-** clock. 
+** clock.
 ** The counter will be reset to 0 when it reaches it's
 ** output compare value.
 */
 void init_timer2(void)
 {
-	/* Reset clock tick count. L indicates a long (32 bit) 
-	** constant. 
+	uint8_t i;
+
+	/* Reset clock tick count. L indicates a long (32 bit)
+	** constant.
 	*/
 	clockTicks = 0L;
+	ticksThisPeriod = 1;
+	tickless = 1;
+
+	/* Stagger the jobs so they don't all run in the same tick */
+	for(i=0; i < NUM_TICK_TASKS; i++) {
+		tickCountdown[i] = i + 1;
+		tickMaxCounts[i] = 0;
+		tickOverruns[i] = 0;
+	}
 
 	/* Set the output compare value to be 124 */
-	OCR2 = 124;
+	OCR2 = COUNTS_PER_TICK - 1;
 
-	/* Enable an interrupt on output compare match. 
+	/* Enable an interrupt on output compare match.
 	** Note that interrupts have to be enabled globally
 	** before the interrupts will fire.
 	*/
@@ -44,28 +135,289 @@ void init_timer2(void)
 	** running.
 	*/
 	TCCR2 = (1<<WGM21)|(0<<WGM20)|(0<<CS22)|(1<<CS21)|(1<<CS20);
+
+	/* Idle sleep mode stops the CPU but leaves the timers
+	** and the SPI port running, so any interrupt wakes us.
+	*/
+	set_sleep_mode(SLEEP_MODE_IDLE);
+
+	sleepCounts = 0;
+	countersResetTime = 0;
 }
 
-uint32_t get_clock_ticks(void) 
+uint32_t get_clock_ticks(void)
 {
-	uint32_t returnValue;
+	uint32_t ticks;
+	uint8_t counts;
 
-	/* Disable interrupts so we can be sure that the interrupt
-	** doesn't fire when we've copied just a couple of bytes
-	** of the value. Interrupts are re-enabled if they were
-	** enabled at the start.
+	/* We don't disable interrupts here - see read_clock().
+	** If the timer period has been stretched, we may be
+	** part way through its second tick.
 	*/
-	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	read_clock(&ticks, &counts);
+	if(counts >= COUNTS_PER_TICK) {
+		ticks++;
+	}
+	return ticks;
+}
+
+uint16_t get_clock_ticks16(void)
+{
+	uint16_t ticks;
+	uint8_t counts;
+
+	/* Only the low 2 bytes of the tick count are read, so
+	** this is cheaper than get_clock_ticks(). We read again
+	** if the interrupt changed the count while we read it.
+	*/
+	do {
+		ticks = (uint16_t)clockTicks;
+		counts = TCNT2;
+	} while(ticks != (uint16_t)clockTicks);
+	if(counts >= COUNTS_PER_TICK) {
+		ticks++;
+	}
+	return ticks;
+}
+
+uint32_t get_clock_micros(void)
+{
+	uint32_t ticks;
+	uint8_t counts;
+
+	/* Each timer count is 8 microseconds */
+	read_clock(&ticks, &counts);
+	return ticks * 1000 + (uint16_t)counts * 8;
+}
+
+uint32_t clock_elapsed(uint32_t since)
+{
+	return get_clock_ticks() - since;
+}
+
+uint8_t deadline_reached(uint32_t deadline)
+{
+	return TIME_REACHED(get_clock_ticks(), deadline);
+}
+
+void set_tickless_mode(uint8_t enabled)
+{
+	tickless = enabled;
+}
+
+void sleep_until(uint32_t deadline)
+{
+	uint32_t sleepStart;
+	uint8_t counts;
+	int32_t ticksToDeadline;
+
 	cli();
-	returnValue = clockTicks;
-	if(interruptsOn) {
+	if(TIFR & (1<<OCF2)) {
+		/* The timer period has just ended but the interrupt
+		** hasn't run yet - let it update the tick count first.
+		*/
 		sei();
+		return;
 	}
-	return returnValue;
+	counts = TCNT2;
+	ticksToDeadline = (int32_t)(deadline - clockTicks);
+	if(ticksToDeadline <= 0 ||
+			(ticksToDeadline == 1 && counts >= COUNTS_PER_TICK)) {
+		/* Deadline has been reached - don't sleep */
+		sei();
+		return;
+	}
+
+	if(ticksToDeadline < ticksThisPeriod) {
+		/* The period has been stretched past the deadline (which
+		** must have changed since). Shrink it back to 1 tick if the
+		** timer is well short of the new compare value - otherwise
+		** the tick is only a few counts away, so don't sleep.
+		*/
+		if(counts >= COUNTS_PER_TICK - 8) {
+			sei();
+			return;
+		}
+		OCR2 = COUNTS_PER_TICK - 1;
+		ticksThisPeriod = 1;
+	} else if(tickless && ticksThisPeriod == 1 &&
+			ticksToDeadline >= MAX_TICKS_PER_PERIOD &&
+			ticks_until_tick_task() >= MAX_TICKS_PER_PERIOD &&
+			counts < COUNTS_PER_TICK - 8) {
+		/* Nothing (including the jobs run from the interrupt
+		** handler) is due until at least 2 ticks after the start
+		** of this period, so stretch the period to 2 ticks by
+		** moving the compare value. We only do this if the timer
+		** is well short of the current compare value so we can't
+		** miss the match.
+		*/
+		OCR2 = MAX_TICKS_PER_PERIOD * COUNTS_PER_TICK - 1;
+		ticksThisPeriod = MAX_TICKS_PER_PERIOD;
+	}
+
+	/* Sleep until the next interrupt (the timer, or any other).
+	** The instruction after sei() is always executed before any
+	** pending interrupt, so we can't miss a wake up between
+	** sei() and sleep_cpu().
+	*/
+	sleepStart = clockTicks * COUNTS_PER_TICK + counts;
+	sleep_enable();
+	sei();
+	sleep_cpu();
+	sleep_disable();
+	sleepCounts += get_timer_counts() - sleepStart;
+}
+
+void get_energy_counters(uint32_t* activeCycles, uint32_t* sleepCycles)
+{
+	uint32_t total = get_timer_counts() - countersResetTime;
+
+	/* Each timer count is 64 CPU cycles */
+	*sleepCycles = sleepCounts * 64;
+	*activeCycles = (total - sleepCounts) * 64;
+}
+
+uint16_t get_active_permille(void)
+{
+	uint32_t total = get_timer_counts() - countersResetTime;
+	uint32_t active = total - sleepCounts;
+
+	if(total == 0) {
+		return 1000;
+	}
+	/* Scale both values down so total * 1000 fits in 32 bits */
+	while(total > 0x3FFFFFUL) {
+		total >>= 1;
+		active >>= 1;
+	}
+	return (uint16_t)((active * 1000) / total);
+}
+
+void reset_energy_counters(void)
+{
+	sleepCounts = 0;
+	countersResetTime = get_timer_counts();
+}
+
+uint8_t get_tick_task_stats(uint8_t task, uint16_t* maxCycles,
+		uint16_t* overruns)
+{
+	if(task >= NUM_TICK_TASKS) {
+		return 0;
+	}
+	*maxCycles = (uint16_t)tickMaxCounts[task] * 64;
+	*overruns = tickOverruns[task];
+	return 1;
+}
+
+/****************** INTERNAL FUNCTIONS *********************/
+
+/* read_clock()
+**  - reads the tick count (at the start of the current timer
+**    period) and the timer count (how far we are into the
+**    period) without disabling interrupts. If the interrupt
+**    handler changes the tick count while we are reading it, we
+**    just read again. If we are called with interrupts disabled
+**    the handler can't run, so we check whether the period has
+**    ended without the handler having run yet (the compare
+**    flag is set) and allow for that.
+*/
+static void read_clock(uint32_t* ticks, uint8_t* counts)
+{
+	uint32_t t;
+	uint32_t adjusted;
+	uint8_t c;
+
+	do {
+		t = clockTicks;
+		adjusted = t;
+		c = TCNT2;
+		if(TIFR & (1<<OCF2)) {
+			/* Timer has been reset to 0 - read it again */
+			c = TCNT2;
+			adjusted += ticksThisPeriod;
+		}
+	} while(t != clockTicks);
+	*ticks = adjusted;
+	*counts = c;
+}
+
+/* get_timer_counts()
+**  - returns the time in timer counts (8 microseconds) since the
+**    timer was started.
+*/
+static uint32_t get_timer_counts(void)
+{
+	uint32_t ticks;
+	uint8_t counts;
+
+	read_clock(&ticks, &counts);
+	return ticks * COUNTS_PER_TICK + counts;
+}
+
+/* ticks_until_tick_task()
+**  - returns the number of ticks from the start of the current
+**    timer period until the next job in the tickTasks table is due.
+*/
+static uint8_t ticks_until_tick_task(void)
+{
+	uint8_t i;
+	uint8_t ticks = 0xFF;
+
+	for(i=0; i < NUM_TICK_TASKS; i++) {
+		if(tickCountdown[i] < ticks) {
+			ticks = tickCountdown[i];
+		}
+	}
+	return ticks;
 }
 
-ISR(TIMER2_COMP_vect) 
+ISR(TIMER2_COMP_vect)
 {
+	/* The timer was reset to 0 at the compare match, so its count
+	** is the time since then (in units of 64 cycles).
+	*/
+	ISR_LATENCY_RECORD(LATENCY_TICK, (uint16_t)TCNT2 * 64);
+	PROFILE_BEGIN(PROF_TICK_ISR);
+	uint8_t ticks = ticksThisPeriod;
+	uint8_t i;
+	uint8_t start, elapsed;
+
 	/* Increment our clock tick count */
-	clockTicks++;
+	clockTicks += ticks;
+	TRACE_BEGIN(TRACE_TICK_ISR);
+
+	/* If the period was stretched, go back to 1 tick periods.
+	** The timer has just been reset to 0 so it is safe to
+	** change the compare value.
+	*/
+	if(ticks != 1) {
+		OCR2 = COUNTS_PER_TICK - 1;
+		ticksThisPeriod = 1;
+	}
+
+	/* Run the jobs that are due, in priority order */
+	for(i=0; i < NUM_TICK_TASKS; i++) {
+		if(tickCountdown[i] > ticks) {
+			tickCountdown[i] -= ticks;
+			continue;
+		}
+		/* Job is due (or a tick late if the period was stretched
+		** past it - we keep the job on its original phase).
+		*/
+		tickCountdown[i] += tickTasks[i].period - ticks;
+
+		start = TCNT2;
+		tickTasks[i].function();
+		elapsed = TCNT2 - start;
+
+		if(elapsed > tickMaxCounts[i]) {
+			tickMaxCounts[i] = elapsed;
+		}
+		if((uint16_t)elapsed * 64 > tickTasks[i].budget) {
+			tickOverruns[i]++;
+		}
+	}
+	TRACE_END(TRACE_TICK_ISR);
+	PROFILE_END(PROF_TICK_ISR);
 }
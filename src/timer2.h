@@ -7,6 +7,11 @@
 ** be added to the main event loop that checks the
 ** clock tick value. This value (32 bits) can be 
 ** obtained using the get_clock_ticks() function.
+**
+** When there is nothing to do, the main event loop can
+** call sleep_until() to put the CPU to sleep until the
+** next deadline. In tickless mode the timer interrupt is
+** skipped when nothing is due, so we wake up less often.
 */
 
 #ifndef TIMER2_H
@@ -16,6 +21,89 @@
 
 void init_timer2(void);
 
+/* Returns the clock tick count (milliseconds since the timer
+** was initialised). This doesn't disable interrupts, so it is
+** safe (and cheap) to call from anywhere, including interrupt
+** handlers.
+*/
 uint32_t get_clock_ticks(void);
 
+/* The clock tick count itself, and the number of ticks in the
+** current timer period (1, or 2 if it has been stretched). Only for
+** trace.h, which must read the time in a few cycles (with interrupts
+** off) - use the functions here instead.
+*/
+extern volatile uint32_t clockTicks;
+extern volatile uint8_t ticksThisPeriod;
+
+/* Returns the low 16 bits of the clock tick count. Cheaper than
+** get_clock_ticks() and fine for timing intervals of up to 32
+** seconds (see TIME_REACHED16 below). May be a tick behind if
+** called with interrupts disabled.
+*/
+uint16_t get_clock_ticks16(void);
+
+/* Returns a timestamp in microseconds (with a resolution of 8
+** microseconds - one timer count). Wraps around every 71 minutes.
+** Like get_clock_ticks(), this can be called from anywhere.
+*/
+uint32_t get_clock_micros(void);
+
+/* Has the given time (deadline) been reached, given the current
+** time ("now")? Times are clock tick values. We compare the
+** difference between the times rather than the times themselves,
+** so these still work when the tick count wraps around (as long as
+** the times are within 24 days, or 32 seconds for the 16 bit
+** version, of each other). Don't use "now >= last + interval".
+*/
+#define TIME_REACHED(now, deadline) ((int32_t)((now) - (deadline)) >= 0)
+#define TIME_REACHED16(now, deadline) ((int16_t)((now) - (deadline)) >= 0)
+
+/* Returns the number of clock ticks since the given tick value
+** (correct across wrap around).
+*/
+uint32_t clock_elapsed(uint32_t since);
+
+/* Returns 1 if the given deadline (clock tick value) has been
+** reached, 0 otherwise (correct across wrap around).
+*/
+uint8_t deadline_reached(uint32_t deadline);
+
+/* Enable (1) or disable (0) tickless mode. When enabled
+** (the default), sleep_until() may stretch the timer period
+** to 2ms so the 1ms interrupt is skipped. The clock tick
+** count is accurate either way.
+*/
+void set_tickless_mode(uint8_t enabled);
+
+/* Put the CPU in idle sleep mode until the given clock tick
+** value is reached - or until any interrupt occurs, which
+** may be sooner. Returns straight away if the deadline has
+** already been reached. Must be called with interrupts
+** enabled (and not from an interrupt handler).
+*/
+void sleep_until(uint32_t deadline);
+
+/* Energy counters. Report the number of CPU cycles spent
+** active (running) and asleep since the counters were last
+** reset (or since the timer was initialised). The cycle
+** counts are accurate to 64 cycles and wrap around after
+** about 9 minutes, so the counters should be reset after
+** each reading. get_active_permille() gives the fraction
+** of time spent active, in parts per thousand.
+*/
+void get_energy_counters(uint32_t* activeCycles, uint32_t* sleepCycles);
+uint16_t get_active_permille(void);
+void reset_energy_counters(void);
+
+/* Statistics for the jobs run from the timer interrupt
+** handler (numbered from 0 in priority order - see the
+** tickTasks table in timer2.c). Gives the longest time the
+** job has taken (in CPU cycles, to the nearest 64) and the
+** number of times it has taken longer than its budget.
+** Returns 0 if there is no such job.
+*/
+uint8_t get_tick_task_stats(uint8_t task, uint16_t* maxCycles,
+		uint16_t* overruns);
+
 #endif
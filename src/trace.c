@@ -0,0 +1,119 @@
+/*
+** trace.c
+**
+** Timeline trace - see trace.h.
+**
+** traceHead is where the next event is recorded. Slots that haven't
+** been used since the buffer was emptied have type TRACE_TYPE_EMPTY,
+** so if the slot at traceHead is empty the buffer hasn't wrapped
+** around and the events are in slots 0 to traceHead - 1; otherwise
+** the oldest event is at traceHead. (That is worked out when the
+** buffer is sent, to keep it out of trace_record().)
+*/
+
+#include "trace.h"
+#include "uart.h"
+#include "scheduler.h"
+
+#ifdef TRACE
+
+#if (TRACE_BUFFER_EVENTS & TRACE_MASK) || TRACE_BUFFER_EVENTS > 256
+#error "TRACE_BUFFER_EVENTS must be a power of 2, at most 256"
+#endif
+
+#define DUMP_PERIOD_MS 5
+
+/* See comment in .h file */
+TraceEvent traceBuffer[TRACE_BUFFER_EVENTS];
+uint8_t traceHead;
+uint8_t traceRecording;
+
+/* Dump progress - the dump task, the slot of the next event to send,
+** the number of events sent and the number to send.
+*/
+static uint8_t dumpTask = NO_TASK;
+static uint8_t dumpSlot;
+static uint16_t dumpSent;
+static uint16_t dumpTotal;
+
+/* Private functions - only used within this module */
+static void trace_dump_task(void);
+
+/* See comment in .h file */
+void init_trace(void)
+{
+	uint16_t i;
+
+	for(i=0; i < TRACE_BUFFER_EVENTS; i++) {
+		traceBuffer[i].type = TRACE_TYPE_EMPTY;
+	}
+	traceHead = 0;
+	traceRecording = 1;
+}
+
+/* See comment in .h file */
+uint8_t trace_dump_start(void)
+{
+	if(dumpTask != NO_TASK) {
+		return 0;
+	}
+	dumpTask = add_task(trace_dump_task, DUMP_PERIOD_MS, 0);
+	if(dumpTask == NO_TASK) {
+		return 0;
+	}
+
+	/* Stop recording so the buffer doesn't change under us. (A
+	** single byte is written, so interrupts needn't be turned off.)
+	*/
+	traceRecording = 0;
+	if(traceBuffer[traceHead].type != TRACE_TYPE_EMPTY) {
+		dumpSlot = traceHead;
+		dumpTotal = TRACE_BUFFER_EVENTS;
+	} else {
+		dumpSlot = 0;
+		dumpTotal = traceHead;
+	}
+	dumpSent = 0;
+	return 1;
+}
+
+/****************** INTERNAL FUNCTIONS *********************/
+
+/* trace_dump_task()
+**  - send as many frames of events as there is room for in the
+**    serial buffer. When all have been sent (including the frame
+**    with no events that marks the end), empty the buffer and start
+**    recording again.
+*/
+static void trace_dump_task(void)
+{
+	uint8_t frame[2 + TRACE_EVENTS_PER_FRAME * sizeof(TraceEvent)];
+	TraceEvent* events = (TraceEvent*)&frame[2];
+	uint8_t count;
+
+	while(1) {
+		frame[0] = dumpSent & 0xFF;
+		frame[1] = dumpSent >> 8;
+		for(count = 0; count < TRACE_EVENTS_PER_FRAME
+				&& dumpSent + count < dumpTotal; count++) {
+			events[count] = traceBuffer[(dumpSlot + count) & TRACE_MASK];
+		}
+		if(!uart_send_frame(FRAME_TRACE, frame,
+				2 + count * sizeof(TraceEvent))) {
+			/* No room - try again next time */
+			return;
+		}
+		if(count == 0) {
+			/* Sent the end frame */
+			break;
+		}
+		dumpSlot = (dumpSlot + count) & TRACE_MASK;
+		dumpSent += count;
+	}
+
+	remove_task(dumpTask);
+	dumpTask = NO_TASK;
+	init_trace();
+}
+
+#endif
@@ -0,0 +1,150 @@
+/*
+** trace.h
+**
+** Timeline trace. TRACE_BEGIN(id), TRACE_END(id) and TRACE_INSTANT(id)
+** record an event - its 16 bit ID, its type and the time (to 8
+** microseconds) - in a circular buffer in RAM which holds the last
+** TRACE_BUFFER_EVENTS events. Unlike the profile statistics (see
+** profile.h) this shows the order things happened in, e.g. an
+** interrupt handler that ran in the middle of
+** copy_game_field_to_led_display().
+**
+** The buffer is sent over the serial port by the CMD_TRACE_DUMP
+** command (see command.h) in FRAME_TRACE frames. Each frame holds:
+**
+**		number of the first event in the frame (2 bytes), then up to
+**		TRACE_EVENTS_PER_FRAME events (TraceEvent below)
+**
+** oldest first, followed by a frame with no events. Nothing is
+** recorded while the buffer is being sent; it is emptied afterwards.
+** tools/trace_to_chrome.py turns the events into a Chrome trace
+** (JSON) file, which can be viewed in chrome://tracing or Perfetto.
+**
+** Recording an event is a short run of stores with interrupts off,
+** so events can be used in interrupt handlers. It is more than a bare
+** timestamp would take, because the tick interrupt may be pending
+** (see TRACE_TICKS_PENDING) and that has to be checked for the events
+** to come out in the right order. Begin and end events for the same
+** ID must be in the same function.
+**
+** Only compiled in if TRACE is defined. Otherwise the macros and
+** functions below compile to nothing.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/* Event IDs. Any 16 bit value can be used; tools/trace_to_chrome.py
+** gets the names of these from this file.
+*/
+enum {
+	TRACE_TICK_ISR = 1,
+	TRACE_SPI_ISR,
+	TRACE_LOGIC_STEP,
+	TRACE_COPY_FIELD,
+	TRACE_FIRE
+};
+
+/* Scheduled tasks are traced as TRACE_TASK + task ID (see
+** scheduler.h)
+*/
+#define TRACE_TASK 0x100
+
+/* Number of events kept - must be a power of 2, at most 256 */
+#ifndef TRACE_BUFFER_EVENTS
+#define TRACE_BUFFER_EVENTS 128
+#endif
+
+/* Events sent in each FRAME_TRACE frame */
+#define TRACE_EVENTS_PER_FRAME 10
+
+/* Event types (the low 6 bits of "type") */
+#define TRACE_TYPE_BEGIN 0
+#define TRACE_TYPE_END 1
+#define TRACE_TYPE_INSTANT 2
+#define TRACE_TYPE_EMPTY 0x3F	/* slot not yet used */
+#define TRACE_TYPE_MASK 0x3F
+
+/* The top 2 bits of "type" are the number of ticks "ticks" is behind:
+** if the tick interrupt was due but hadn't run yet when the event was
+** recorded, the timer period has ended (1 tick, or 2 if it had been
+** stretched - see timer2.c) without the tick count being updated.
+*/
+#define TRACE_TICKS_PENDING_SHIFT 6
+
+/* An event. The time is ticks milliseconds (the low 16 bits of the
+** clock tick count - see timer2.h) plus counts * 8 microseconds.
+*/
+typedef struct {
+	uint16_t id;
+	uint16_t ticks;
+	uint8_t counts;
+	uint8_t type;
+} TraceEvent;
+
+#ifdef TRACE
+
+#include "hal.h"
+#include "timer2.h"
+
+#define TRACE_MASK (TRACE_BUFFER_EVENTS - 1)
+
+/* Used by trace_record() - don't use directly */
+extern TraceEvent traceBuffer[TRACE_BUFFER_EVENTS];
+extern uint8_t traceHead;
+extern uint8_t traceRecording;
+
+/* init_trace()
+** - empties the buffer and starts recording.
+*/
+void init_trace(void);
+
+/* trace_dump_start()
+** - starts sending the buffer (from a scheduled task, a frame at a
+** time as there is room in the serial buffer). Returns 0 if the
+** buffer is already being sent (or there is no room for the task),
+** 1 otherwise.
+*/
+uint8_t trace_dump_start(void);
+
+/* Used by the macros below. Inline so that recording is quick. */
+static inline void trace_record(uint16_t id, uint8_t type)
+{
+	uint8_t sreg = SREG;
+	TraceEvent* event;
+
+	cli();
+	if(traceRecording) {
+		event = &traceBuffer[traceHead];
+		event->id = id;
+		event->ticks = (uint16_t)clockTicks;
+		event->counts = TCNT2;
+		if(TIFR & (1<<OCF2)) {
+			/* The period ended - maybe after TCNT2 was read, so
+			** read it again (as read_clock() in timer2.c does).
+			*/
+			event->counts = TCNT2;
+			type |= ticksThisPeriod << TRACE_TICKS_PENDING_SHIFT;
+		}
+		event->type = type;
+		traceHead = (traceHead + 1) & TRACE_MASK;
+	}
+	SREG = sreg;
+}
+
+#define TRACE_BEGIN(id) trace_record(id, TRACE_TYPE_BEGIN)
+#define TRACE_END(id) trace_record(id, TRACE_TYPE_END)
+#define TRACE_INSTANT(id) trace_record(id, TRACE_TYPE_INSTANT)
+
+#else
+
+#define init_trace()
+#define TRACE_BEGIN(id)
+#define TRACE_END(id)
+#define TRACE_INSTANT(id)
+
+#endif
+
+#endif
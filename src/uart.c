@@ -0,0 +1,181 @@
+/*
+** uart.c
+**
+** Serial port - see uart.h.
+**
+** The transmit buffer is a ring buffer. txHead is where the next byte
+** is added and txTail is the next byte to send; the buffer is empty
+** when they are equal (so it holds at most UART_TX_BUFFER_SIZE - 1
+** bytes). Only uart_send_frame() changes txHead and only the
+** interrupt handler changes txTail.
+**
+** The receive buffer works the same way, except that the interrupt
+** handler adds bytes (at rxHead) and uart_receive() takes them (from
+** rxTail).
+*/
+
+#include "hal.h"
+#include <util/crc16.h>
+#include "uart.h"
+#include "atomic_section.h"
+
+#define UBRR_VALUE ((8000000UL + 4 * UART_BAUD) / (8 * UART_BAUD) - 1)
+#define TX_MASK (UART_TX_BUFFER_SIZE - 1)
+#define RX_MASK (UART_RX_BUFFER_SIZE - 1)
+
+#if UART_TX_BUFFER_SIZE & TX_MASK
+#error "UART_TX_BUFFER_SIZE must be a power of 2"
+#endif
+#if UART_RX_BUFFER_SIZE & RX_MASK
+#error "UART_RX_BUFFER_SIZE must be a power of 2"
+#endif
+
+static uint8_t txBuffer[UART_TX_BUFFER_SIZE];
+static volatile uint8_t txHead;
+static volatile uint8_t txTail;
+static uint16_t droppedFrames;
+
+static uint8_t rxBuffer[UART_RX_BUFFER_SIZE];
+static volatile uint8_t rxHead;
+static volatile uint8_t rxTail;
+static volatile uint16_t lostBytes;
+
+/* See comment in .h file */
+void init_uart(void)
+{
+	txHead = 0;
+	txTail = 0;
+	droppedFrames = 0;
+	rxHead = 0;
+	rxTail = 0;
+	lostBytes = 0;
+
+	UBRR0H = UBRR_VALUE >> 8;
+	UBRR0L = UBRR_VALUE & 0xFF;
+	UCSR0A = (1<<U2X0);
+	/* Asynchronous, 8 data bits, no parity, 1 stop bit */
+	UCSR0C = (1<<UCSZ01)|(1<<UCSZ00);
+	UCSR0B = (1<<TXEN0)|(1<<RXEN0)|(1<<RXCIE0);
+}
+
+/* See comment in .h file */
+uint8_t uart_send_frame(uint8_t type, const void* payload, uint8_t length)
+{
+	const uint8_t* bytes = payload;
+	uint8_t queued = 0;
+	uint8_t crc;
+	uint8_t head;
+	uint8_t i;
+
+	if(length > UART_MAX_PAYLOAD) {
+		return 0;
+	}
+
+	/* The whole frame is added with interrupts off, so that frames
+	** sent from interrupt handlers don't get mixed up with ours.
+	** (A full frame takes about 600 cycles to add.)
+	*/
+	ATOMIC_SECTION(ATOMIC_UART_SEND) {
+		head = txHead;
+		if(((txTail - head - 1) & TX_MASK) < length + 4) {
+			/* Not enough room */
+			droppedFrames++;
+			break;
+		}
+		txBuffer[head] = UART_SYNC;
+		head = (head + 1) & TX_MASK;
+		txBuffer[head] = type;
+		head = (head + 1) & TX_MASK;
+		txBuffer[head] = length;
+		head = (head + 1) & TX_MASK;
+		crc = _crc8_ccitt_update(0, type);
+		crc = _crc8_ccitt_update(crc, length);
+		for(i = 0; i < length; i++) {
+			txBuffer[head] = bytes[i];
+			head = (head + 1) & TX_MASK;
+			crc = _crc8_ccitt_update(crc, bytes[i]);
+		}
+		txBuffer[head] = crc;
+		txHead = (head + 1) & TX_MASK;
+
+		/* Start (or keep) the interrupt handler sending */
+		UCSR0B |= (1<<UDRIE0);
+		queued = 1;
+	}
+	return queued;
+}
+
+/* See comment in .h file */
+uint16_t uart_get_dropped_frames(void)
+{
+	uint16_t dropped;
+
+	ATOMIC_SECTION(ATOMIC_UART_SEND) {
+		dropped = droppedFrames;
+	}
+	return dropped;
+}
+
+/* See comment in .h file */
+uint8_t uart_receive(uint8_t* byte)
+{
+	uint8_t tail = rxTail;
+
+	if(tail == rxHead) {
+		return 0;
+	}
+	*byte = rxBuffer[tail];
+	rxTail = (tail + 1) & RX_MASK;
+	return 1;
+}
+
+/* See comment in .h file */
+uint16_t uart_get_lost_bytes(void)
+{
+	uint16_t lost;
+
+	ATOMIC_SECTION(ATOMIC_UART_RECEIVE) {
+		lost = lostBytes;
+	}
+	return lost;
+}
+
+/* Data register empty - send the next byte, or turn the interrupt
+** off if there is nothing more to send.
+*/
+ISR(USART0_UDRE_vect)
+{
+	uint8_t tail = txTail;
+
+	if(tail == txHead) {
+		UCSR0B &= ~(1<<UDRIE0);
+		return;
+	}
+	UDR0 = txBuffer[tail];
+	txTail = (tail + 1) & TX_MASK;
+}
+
+/* Receive complete - add the byte to the receive buffer. (UDR0 must
+** be read to clear the interrupt, even if we don't keep the byte.)
+*/
+ISR(USART0_RX_vect)
+{
+	uint8_t errors = UCSR0A & ((1<<FE0)|(1<<DOR0));
+	uint8_t byte = UDR0;
+	uint8_t head = rxHead;
+	uint8_t next = (head + 1) & RX_MASK;
+
+	if(errors) {
+		/* The byte is bad, or bytes before it were lost */
+		lostBytes++;
+		if(errors & (1<<FE0)) {
+			return;
+		}
+	}
+	if(next == rxTail) {
+		lostBytes++;
+		return;
+	}
+	rxBuffer[head] = byte;
+	rxHead = next;
+}
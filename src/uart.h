@@ -0,0 +1,87 @@
+/*
+** uart.h
+**
+** Serial port (USART0 - TXD on PE1, RXD on PE0) for exchanging data
+** with a PC. Data is sent in frames:
+**
+**		0xA5, type, length, payload (length bytes), CRC
+**
+** where the CRC is the CRC-8 (polynomial 0x07, initial value 0) of
+** the type, length and payload bytes. The receiver can find the start
+** of a frame by looking for the sync byte (0xA5) and checking the CRC.
+**
+** Frames are put in a buffer and sent from the USART data register
+** empty interrupt, so sending never waits. If there isn't room in the
+** buffer for a whole frame the frame is dropped (and counted).
+**
+** Received bytes are put in another buffer by the receive complete
+** interrupt, to be read (e.g. by the command parser - see command.h)
+** from the main program. Bytes that arrive when that buffer is full
+** are lost (and counted).
+*/
+
+#ifndef UART_H
+#define UART_H
+
+#include <stdint.h>
+
+/* Baud rate. The USART runs in double speed mode, so at 8MHz rates
+** of 38400 (0.2% error) or 76800 (0.2% error) are good choices.
+*/
+#ifndef UART_BAUD
+#define UART_BAUD 38400UL
+#endif
+
+/* Size of the transmit and receive buffers (bytes) - must be
+** powers of 2
+*/
+#define UART_TX_BUFFER_SIZE 128
+#define UART_RX_BUFFER_SIZE 64
+
+/* Maximum frame payload */
+#define UART_MAX_PAYLOAD 64
+
+/* Start of frame (sync) byte */
+#define UART_SYNC 0xA5
+
+/* Frame types */
+#define FRAME_TELEMETRY 0x01	/* see telemetry.h */
+#define FRAME_DISPLAY_KEY 0x02	/* see display_mirror.h */
+#define FRAME_DISPLAY_DELTA 0x03
+#define FRAME_REPLY 0x04		/* see command.h */
+#define FRAME_TRACE 0x05		/* see trace.h */
+
+/* init_uart()
+** - sets up USART0 for 8 data bits, no parity, 1 stop bit, and
+** starts receiving.
+*/
+void init_uart(void);
+
+/* uart_send_frame()
+** - queue a frame with the given type and payload (length bytes,
+** at most UART_MAX_PAYLOAD). Returns 1 if the frame was queued, or
+** 0 if it was dropped because the buffer is full. Never waits. Can
+** be called from interrupt handlers.
+*/
+uint8_t uart_send_frame(uint8_t type, const void* payload, uint8_t length);
+
+/* uart_get_dropped_frames()
+** - returns the number of frames that have been dropped because the
+** buffer was full.
+*/
+uint16_t uart_get_dropped_frames(void);
+
+/* uart_receive()
+** - if a byte has been received, stores it in *byte and returns 1.
+** Returns 0 if there is nothing to read. Never waits.
+*/
+uint8_t uart_receive(uint8_t* byte);
+
+/* uart_get_lost_bytes()
+** - returns the number of received bytes that have been lost because
+** the receive buffer was full (or the USART overran) or that were
+** received with a framing error.
+*/
+uint16_t uart_get_lost_bytes(void);
+
+#endif
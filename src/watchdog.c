@@ -0,0 +1,122 @@
+/*
+** watchdog.c
+**
+** Stall detection - see watchdog.h.
+*/
+
+#include "hal.h"
+#include <avr/wdt.h>
+#include "watchdog.h"
+#include "scheduler.h"
+#include "timer2.h"
+
+/* The post-mortem record. This is in the .noinit section so it is
+** not cleared by the start up code (and is not overwritten by the
+** stack painting in stack_monitor.c).
+*/
+static PostMortem postMortem __attribute__((section(".noinit")));
+
+/* Copy of the record from before the last reset - valid if
+** watchdogReset is 1.
+*/
+static PostMortem lastPostMortem;
+static uint8_t watchdogReset;
+
+/* Main event loop statistics. loopStartTime is when the current
+** iteration started; longestTask and longestTaskTime are for the
+** task that has taken longest so far in this iteration.
+*/
+static uint32_t loopStartTime;
+static uint8_t longestTask;
+static uint32_t longestTaskTime;
+static uint32_t maxLoopTime;
+static uint8_t maxLoopTask;
+
+/* See comment in .h file */
+void init_watchdog(void)
+{
+	watchdogReset = 0;
+	if((MCUCSR & (1<<WDRF)) && postMortem.magic == POST_MORTEM_MAGIC) {
+		lastPostMortem = postMortem;
+		watchdogReset = 1;
+	}
+	/* Clear the reset flags so we can tell next time */
+	MCUCSR = 0;
+
+	postMortem.magic = POST_MORTEM_MAGIC;
+	postMortem.taskId = NO_TASK;
+	postMortem.timestamp = 0;
+	postMortem.stackPointer = 0;
+
+	longestTask = NO_TASK;
+	longestTaskTime = 0;
+	maxLoopTime = 0;
+	maxLoopTask = NO_TASK;
+	loopStartTime = 0;
+
+	wdt_enable(WATCHDOG_TIMEOUT);
+}
+
+/* See comment in .h file */
+uint8_t watchdog_get_post_mortem(PostMortem* record)
+{
+	if(watchdogReset) {
+		*record = lastPostMortem;
+	}
+	return watchdogReset;
+}
+
+/* See comment in .h file */
+void watchdog_kick(void)
+{
+	wdt_reset();
+}
+
+/* See comment in .h file */
+uint8_t watchdog_task_start(uint8_t taskId)
+{
+	uint8_t previousTask = postMortem.taskId;
+
+	wdt_reset();
+	postMortem.taskId = taskId;
+	postMortem.timestamp = get_clock_ticks();
+	postMortem.stackPointer = SP;
+	return previousTask;
+}
+
+/* See comment in .h file */
+void watchdog_task_end(uint8_t taskId, uint8_t previousTask,
+		uint32_t micros)
+{
+	postMortem.taskId = previousTask;
+	if(micros > longestTaskTime) {
+		longestTaskTime = micros;
+		longestTask = taskId;
+	}
+}
+
+/* See comment in .h file */
+void watchdog_loop_start(void)
+{
+	loopStartTime = get_clock_micros();
+	longestTask = NO_TASK;
+	longestTaskTime = 0;
+}
+
+/* See comment in .h file */
+void watchdog_loop_end(void)
+{
+	uint32_t loopTime = get_clock_micros() - loopStartTime;
+
+	if(loopTime > maxLoopTime) {
+		maxLoopTime = loopTime;
+		maxLoopTask = longestTask;
+	}
+}
+
+/* See comment in .h file */
+void watchdog_get_stall_stats(uint32_t* maxLoopMicros, uint8_t* taskId)
+{
+	*maxLoopMicros = maxLoopTime;
+	*taskId = maxLoopTask;
+}
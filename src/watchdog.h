@@ -0,0 +1,83 @@
+/*
+** watchdog.h
+**
+** Stall detection. The hardware watchdog resets the board if the
+** scheduler stops running tasks for WATCHDOG_TIMEOUT (e.g. because a
+** task is stuck in a loop). The scheduler tells this module each
+** time it runs a task; the ID of the task, the time and the stack
+** pointer are kept in a post-mortem record in RAM that is not
+** cleared at reset (the .noinit section). After a watchdog reset
+** the record shows which task was running when the board stalled.
+**
+** We also keep track of the longest iteration of the main event
+** loop and the task that took longest during it, to find latency
+** spikes that are not long enough to cause a reset.
+*/
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <stdint.h>
+#include <avr/wdt.h>
+
+/* Time without the scheduler running before the board is reset */
+#define WATCHDOG_TIMEOUT WDTO_500MS
+
+/* Post-mortem record */
+typedef struct {
+	uint16_t magic;			/* POST_MORTEM_MAGIC if valid */
+	uint8_t taskId;			/* task running (NO_TASK if none) */
+	uint32_t timestamp;		/* clock ticks when it started */
+	uint16_t stackPointer;	/* stack pointer when it started */
+} PostMortem;
+
+#define POST_MORTEM_MAGIC 0x5AFE
+
+/* init_watchdog()
+** - checks whether the last reset was caused by the watchdog (and
+** if so keeps a copy of the post-mortem record), then starts the
+** watchdog. Should be called early, before interrupts are enabled.
+*/
+void init_watchdog(void);
+
+/* watchdog_get_post_mortem()
+** - if the last reset was caused by the watchdog, copies the
+** post-mortem record into *record and returns 1. Returns 0
+** otherwise.
+*/
+uint8_t watchdog_get_post_mortem(PostMortem* record);
+
+/* watchdog_kick()
+** - restarts the watchdog timeout. Called by the scheduler.
+*/
+void watchdog_kick(void);
+
+/* watchdog_task_start() / watchdog_task_end()
+** - called by the scheduler before and after it runs a task. Tasks
+** may be nested (a task may run other tasks), so
+** watchdog_task_start() returns the ID of the task that was running
+** (or NO_TASK), which must be passed back to watchdog_task_end()
+** along with the time (in microseconds) the task took.
+*/
+uint8_t watchdog_task_start(uint8_t taskId);
+void watchdog_task_end(uint8_t taskId, uint8_t previousTask,
+		uint32_t micros);
+
+/* watchdog_loop_start() / watchdog_loop_end()
+** - called at the start of each iteration of the main event loop
+** and before it goes to sleep. Loops that wait inside an iteration
+** (gameOver() and game_pause_loop() in project.c) also call
+** watchdog_loop_end() before each sleep and watchdog_loop_start()
+** after it, so the time they wait isn't counted as a stall.
+*/
+void watchdog_loop_start(void);
+void watchdog_loop_end(void);
+
+/* watchdog_get_stall_stats()
+** - gets the longest main event loop iteration (in microseconds)
+** and the ID of the task that took the longest time during it (or
+** NO_TASK if no task ran).
+*/
+void watchdog_get_stall_stats(uint32_t* maxLoopMicros, uint8_t* taskId);
+
+#endif
@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+"""
+bench_check.py
+
+Runs the benchmark firmware (see src/bench.c) under the simavr
+simulator and checks the cycle counts it reports against the budgets
+in src/bench_budgets.txt. Exits with status 1 if any measurement is
+over its budget, has no budget recorded ("-") or is missing, so a
+change that makes the game functions or interrupt handlers slower
+fails "make bench".
+
+Usage:
+    bench_check.py [--simavr run_avr] [--mcu atmega128]
+                   [--budgets bench_budgets.txt] [--update]
+                   bench.elf [bench_dds.elf ...]
+
+Each image given is run in turn and their results are checked
+together (the DDS synthesiser is measured in images of its own - see
+bench.c).
+
+--update sets each budget to the cycles measured plus 10% (rounded
+up), for after a change that is meant to take longer, or to record
+budgets for new measurements. The DDS budgets (TIMER1_OVF_vect/dds_*)
+are left alone: they are DDS_ISR_BUDGET in src/dds.h, and are changed
+by hand together with it.
+
+simavr has no ATmega64 core, so the ATmega128 is simulated by
+default. It has the same peripherals, registers and interrupt vectors
+(and the same amount of RAM); only its flash is bigger.
+"""
+
+import argparse
+import math
+import re
+import subprocess
+import sys
+
+CPU_HZ = 8000000
+HEADROOM = 1.10
+TIMEOUT_SECONDS = 60
+
+# Budgets that --update leaves alone (see above)
+FIXED_BUDGETS = re.compile(r"TIMER1_OVF_vect/dds_")
+
+RESULT = re.compile(r"BENCH (\S+) (\d+)")
+COLOURS = re.compile(r"\x1b\[[0-9;]*m")
+
+
+def run_bench(simavr, mcu, elf):
+    """Return a dictionary of measurement name to cycles from a run of
+    the benchmark firmware."""
+    try:
+        run = subprocess.run([simavr, "-m", mcu, "-f", str(CPU_HZ), elf],
+                             capture_output=True, text=True,
+                             errors="replace", timeout=TIMEOUT_SECONDS)
+    except FileNotFoundError:
+        sys.exit("bench_check.py: %s not found - is simavr installed?"
+                 % simavr)
+    except subprocess.TimeoutExpired:
+        sys.exit("bench_check.py: the benchmark didn't finish in %d s"
+                 % TIMEOUT_SECONDS)
+
+    # simavr prints the serial output (in colour) among its own messages
+    output = COLOURS.sub("", run.stdout + run.stderr)
+    results = {}
+    done = False
+    for line in output.splitlines():
+        match = RESULT.search(line)
+        if match:
+            results[match.group(1)] = int(match.group(2))
+        elif "BENCH done" in line:
+            done = True
+    if not done:
+        sys.stderr.write(output)
+        sys.exit("bench_check.py: the benchmark didn't run to the end")
+    return results
+
+
+def read_budgets(path):
+    """Return the budgets (name to cycles, or None if not set) in file
+    order, and the lines of the file."""
+    budgets = {}
+    lines = open(path).read().splitlines()
+    for line in lines:
+        fields = line.split("#")[0].split()
+        if len(fields) == 2:
+            budgets[fields[0]] = None if fields[1] == "-" else int(fields[1])
+    return budgets, lines
+
+
+def budget_for(cycles):
+    """Return the budget for a measurement taking the given cycles."""
+    return int(math.ceil(cycles * HEADROOM))
+
+
+def write_budgets(path, lines, budgets, results):
+    """Rewrite the budgets file with budgets from the results, keeping
+    comments, the order of the measurements and the fixed budgets."""
+    output = []
+    for line in lines:
+        fields = line.split("#")[0].split()
+        if (len(fields) == 2 and fields[0] in results
+                and not FIXED_BUDGETS.match(fields[0])):
+            cycles = results[fields[0]]
+            line = "%-48s %d" % (fields[0], budget_for(cycles))
+        output.append(line)
+    for name, cycles in results.items():
+        if name not in budgets:
+            output.append("%-48s %d" % (name, budget_for(cycles)))
+    open(path, "w").write("\n".join(output) + "\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    parser.add_argument("elf", nargs="+")
+    parser.add_argument("--simavr", default="run_avr")
+    parser.add_argument("--mcu", default="atmega128")
+    parser.add_argument("--budgets", default="bench_budgets.txt")
+    parser.add_argument("--update", action="store_true")
+    args = parser.parse_args()
+
+    results = {}
+    for elf in args.elf:
+        results.update(run_bench(args.simavr, args.mcu, elf))
+    budgets, lines = read_budgets(args.budgets)
+
+    failed = 0
+    print("%-48s %8s %8s" % ("measurement", "cycles", "budget"))
+    for name in list(budgets) + [n for n in results if n not in budgets]:
+        cycles = results.get(name)
+        budget = budgets.get(name)
+        if cycles is None:
+            status = "MISSING"
+            failed += 1
+        elif budget is None:
+            status = "NO BUDGET"
+            failed += 1
+        elif cycles > budget:
+            status = "OVER BUDGET by %d" % (cycles - budget)
+            failed += 1
+        else:
+            status = ""
+        print("%-48s %8s %8s  %s" % (name,
+                                     "-" if cycles is None else cycles,
+                                     "-" if budget is None else budget,
+                                     status))
+
+    if args.update:
+        write_budgets(args.budgets, lines, budgets, results)
+        print("Budgets written to %s" % args.budgets)
+        return
+    if failed:
+        sys.exit("bench_check.py: %d measurement(s) failed" % failed)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,188 @@
+#!/usr/bin/env python3
+"""
+board_command.py
+
+Sends commands to the board over the serial port (see src/command.h)
+so that tests and benchmarks can be scripted. Can be used from the
+command line or imported:
+
+    board = Board("/dev/ttyUSB0")
+    board.step(100)
+    print(board.get_state())
+
+Usage:
+    board_command.py PORT state
+    board_command.py PORT set-state SCORE HEALTH BASE SEED
+    board_command.py PORT joystick X Y BUTTONS
+    board_command.py PORT release
+    board_command.py PORT step N
+    board_command.py PORT run
+    board_command.py PORT stats {profile,sampler,latency,atomic,input} INDEX
+    board_command.py PORT input-latency
+    board_command.py PORT reset-stats
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+from serial_monitor import FrameParser, make_frame
+
+FRAME_REPLY = 0x04
+
+CMD_JOYSTICK = 0x40
+CMD_GET_STATE = 0x41
+CMD_SET_STATE = 0x42
+CMD_STEP = 0x43
+CMD_RUN = 0x44
+CMD_READ_STATS = 0x45
+CMD_RESET_STATS = 0x46
+
+STATUS_NAMES = ("ok", "unknown command", "bad argument", "not compiled in")
+
+STATS_KINDS = {"profile": 0, "sampler": 1, "latency": 2, "atomic": 3,
+               "input": 4}
+
+# Stages of src/input_latency.h
+INPUT_STAGES = ("polled", "step", "fired", "copied", "scanned", "total")
+
+# Layout of the statistics after the kind and index bytes
+STATS_FORMATS = {
+    "profile": ("<IIHH", ("count", "totalCycles", "minCycles",
+                          "maxCycles")),
+    "sampler": ("<HI", ("bucketCount", "totalSamples")),
+    "latency": ("<HH17H", ("minCycles", "maxCycles")),
+    "atomic": ("<HII", ("maxCycles", "totalCycles", "count")),
+    "input": ("<5H", ("count", "median", "percentile90", "percentile99",
+                      "max")),
+}
+
+
+class CommandError(Exception):
+    pass
+
+
+class Board:
+    def __init__(self, port, baud=38400, timeout=1.0):
+        import serial
+        self.serial = serial.Serial(port, baud, timeout=0.05)
+        self.parser = FrameParser()
+        self.timeout = timeout
+
+    def command(self, command, payload=b""):
+        """Send a command and return its reply data. Raises
+        CommandError if the board reports an error or doesn't
+        reply."""
+        self.serial.write(make_frame(command, bytes(payload)))
+        deadline = time.time() + self.timeout
+        while time.time() < deadline:
+            for frame_type, reply in self.parser.feed(self.serial.read(64)):
+                # Skip telemetry, display frames etc.
+                if frame_type != FRAME_REPLY or reply[0] != command:
+                    continue
+                if reply[1] != 0:
+                    raise CommandError(STATUS_NAMES[reply[1]]
+                                       if reply[1] < len(STATUS_NAMES)
+                                       else "status %d" % reply[1])
+                return reply[2:]
+        raise CommandError("no reply")
+
+    def joystick(self, x, y, buttons=0):
+        self.command(CMD_JOYSTICK, struct.pack("<bbB", x, y, buttons))
+
+    def release_joystick(self):
+        self.command(CMD_JOYSTICK)
+
+    def get_state(self):
+        data = self.command(CMD_GET_STATE)
+        score, health, base, seed, count = struct.unpack("<HbbHB", data[:7])
+        projectiles = list(data[7:7 + count])
+        data = data[7 + count:]
+        asteroids = list(data[1:1 + data[0]])
+        steps_left, lost_bytes, bad_frames = struct.unpack(
+            "<HHH", data[1 + data[0]:])
+        return {"score": score, "health": health, "base": base,
+                "seed": seed, "projectiles": projectiles,
+                "asteroids": asteroids, "stepsLeft": steps_left,
+                "lostBytes": lost_bytes, "badFrames": bad_frames}
+
+    def set_state(self, state):
+        payload = struct.pack("<HbbHB", state["score"], state["health"],
+                              state["base"], state["seed"],
+                              len(state["projectiles"]))
+        payload += bytes(state["projectiles"])
+        payload += bytes([len(state["asteroids"])]) + bytes(state["asteroids"])
+        self.command(CMD_SET_STATE, payload)
+
+    def step(self, steps, wait=True):
+        """Hold the game and run the given number of logic steps. If
+        wait is true, return when they have all been run."""
+        self.command(CMD_STEP, struct.pack("<H", steps))
+        while wait and self.get_state()["stepsLeft"]:
+            time.sleep(0.01)
+
+    def run(self):
+        self.command(CMD_RUN)
+
+    def read_stats(self, kind, index):
+        data = self.command(CMD_READ_STATS,
+                            bytes([STATS_KINDS[kind], index]))
+        fmt, names = STATS_FORMATS[kind]
+        values = struct.unpack(fmt, data[2:])
+        stats = dict(zip(names, values))
+        if kind == "latency":
+            stats["histogram"] = list(values[2:])
+        return stats
+
+    def reset_stats(self):
+        self.command(CMD_RESET_STATS)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    parser.add_argument("--baud", type=int, default=38400)
+    parser.add_argument("port")
+    parser.add_argument("command")
+    parser.add_argument("arguments", nargs="*")
+    args = parser.parse_args()
+
+    board = Board(args.port, args.baud)
+    values = [int(value, 0) for value in args.arguments
+              if value not in STATS_KINDS]
+    if args.command == "state":
+        print(board.get_state())
+    elif args.command == "set-state":
+        state = board.get_state()
+        state.update(zip(("score", "health", "base", "seed"), values))
+        board.set_state(state)
+    elif args.command == "joystick":
+        board.joystick(*values)
+    elif args.command == "release":
+        board.release_joystick()
+    elif args.command == "step":
+        board.step(values[0])
+    elif args.command == "run":
+        board.run()
+    elif args.command == "stats":
+        print(board.read_stats(args.arguments[0], values[0]))
+    elif args.command == "input-latency":
+        print("%-8s %6s %6s %6s %6s  (microseconds)"
+              % ("stage", "p50", "p90", "p99", "max"))
+        for index, stage in enumerate(INPUT_STAGES):
+            stats = board.read_stats("input", index)
+            print("%-8s %6d %6d %6d %6d" % (stage, stats["median"],
+                  stats["percentile90"], stats["percentile99"],
+                  stats["max"]))
+        print("%d presses recorded" % stats["count"])
+    elif args.command == "reset-stats":
+        board.reset_stats()
+    else:
+        parser.error("unknown command " + args.command)
+
+
+if __name__ == "__main__":
+    try:
+        main()
+    except CommandError as error:
+        sys.exit("board_command.py: " + str(error))
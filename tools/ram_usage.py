@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+"""
+ram_usage.py
+
+Lists the RAM used by the firmware's variables, by section (.data,
+.bss and .noinit), largest first, with totals. What is left of the
+4KB of SRAM is shared by the stack (see src/stack_monitor.h for
+measuring how much of it the stack uses).
+
+Usage:
+    ram_usage.py [--nm avr-nm] [--ram 4096] program.elf
+"""
+
+import argparse
+import subprocess
+
+# RAM starts at 0x100 on the ATmega64; avr-nm shows data addresses
+# with 0x800000 added.
+DATA_OFFSET = 0x800000
+
+SECTIONS = {"d": ".data", "b": ".bss"}
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("elf")
+    parser.add_argument("--nm", default="avr-nm")
+    parser.add_argument("--ram", type=int, default=4096,
+                        help="bytes of SRAM (default 4096)")
+    args = parser.parse_args()
+
+    output = subprocess.run([args.nm, "--print-size", "--size-sort",
+                             "--reverse-sort", "--defined-only", args.elf],
+                            check=True, capture_output=True,
+                            text=True).stdout
+
+    # Find where .noinit starts, so those variables can be listed
+    # separately (avr-nm shows them as .bss)
+    symbols = subprocess.run([args.nm, "--defined-only", args.elf],
+                             check=True, capture_output=True,
+                             text=True).stdout
+    addresses = {}
+    for line in symbols.splitlines():
+        fields = line.split()
+        if len(fields) == 3:
+            addresses[fields[2]] = int(fields[0], 16)
+    noinit_start = addresses.get("__noinit_start")
+    noinit_end = addresses.get("__noinit_end")
+
+    variables = {".data": [], ".bss": [], ".noinit": []}
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) != 4 or fields[2].lower() not in SECTIONS:
+            continue
+        address = int(fields[0], 16)
+        size = int(fields[1], 16)
+        section = SECTIONS[fields[2].lower()]
+        if noinit_start is not None and noinit_start <= address < noinit_end:
+            section = ".noinit"
+        variables[section].append((size, fields[3], address - DATA_OFFSET))
+
+    total = 0
+    for section, entries in variables.items():
+        section_total = sum(size for size, _, _ in entries)
+        total += section_total
+        print("%s: %d bytes" % (section, section_total))
+        for size, name, address in entries:
+            print("  %6d  0x%04x  %s" % (size, address, name))
+        print()
+    print("Total: %d of %d bytes (%d left for the stack)" %
+          (total, args.ram, args.ram - total))
+
+
+if __name__ == "__main__":
+    main()
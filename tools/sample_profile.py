@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""
+sample_profile.py
+
+Turns the bucket counts from the sampling profiler (src/sampler.c)
+into a list of the functions the CPU spent its time in.
+
+Usage:
+    sample_profile.py [--bucket-bytes N] [--nm avr-nm] program.elf counts.txt
+
+counts.txt has one line per bucket: the bucket number and the number
+of samples in it (lines starting with # are ignored). The bucket size
+must match SAMPLE_BUCKET_BYTES in sampler.h (default 128).
+
+Function addresses come from the symbol table of the .elf file (via
+avr-nm). When a bucket covers more than one function, its samples are
+shared between them in proportion to the number of bytes of each
+function in the bucket - so figures for small functions are only
+estimates. A larger bucket size gives coarser results.
+"""
+
+import argparse
+import subprocess
+import sys
+
+
+def read_functions(elf, nm):
+    """Return a list of (start, end, name) for each function, sorted
+    by address. Addresses are flash byte addresses."""
+    output = subprocess.run([nm, "--numeric-sort", "--print-size",
+                             "--defined-only", elf],
+                            check=True, capture_output=True,
+                            text=True).stdout
+    functions = []
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) != 4 or fields[2] not in "tTwW":
+            continue
+        start = int(fields[0], 16)
+        size = int(fields[1], 16)
+        functions.append((start, start + size, fields[3]))
+    return functions
+
+
+def read_counts(filename):
+    counts = {}
+    with open(filename) as f:
+        for line in f:
+            line = line.strip()
+            if not line or line.startswith("#"):
+                continue
+            bucket, count = line.split()[:2]
+            counts[int(bucket, 0)] = int(count, 0)
+    return counts
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[1])
+    parser.add_argument("elf")
+    parser.add_argument("counts")
+    parser.add_argument("--bucket-bytes", type=int, default=128)
+    parser.add_argument("--nm", default="avr-nm")
+    args = parser.parse_args()
+
+    functions = read_functions(args.elf, args.nm)
+    counts = read_counts(args.counts)
+    total = sum(counts.values())
+    if total == 0:
+        sys.exit("no samples")
+
+    samples = {}
+    for bucket, count in counts.items():
+        low = bucket * args.bucket_bytes
+        high = low + args.bucket_bytes
+        overlaps = []
+        for start, end, name in functions:
+            overlap = min(end, high) - max(start, low)
+            if overlap > 0:
+                overlaps.append((overlap, name))
+        if not overlaps:
+            overlaps = [(1, "<bucket %d: 0x%04x>" % (bucket, low))]
+        covered = sum(o for o, _ in overlaps)
+        for overlap, name in overlaps:
+            samples[name] = samples.get(name, 0) + count * overlap / covered
+
+    print("%8s %6s  %s" % ("samples", "%", "function"))
+    for name, count in sorted(samples.items(), key=lambda s: -s[1]):
+        print("%8.1f %6.2f  %s" % (count, 100.0 * count / total, name))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,205 @@
+#!/usr/bin/env python3
+"""
+serial_monitor.py
+
+Shows the frames sent by the board over the serial port (see
+src/uart.h): telemetry records (src/telemetry.h) are printed and the
+LED display stream (src/display_mirror.h) is drawn in the terminal.
+
+Usage:
+    serial_monitor.py [--baud N] [--no-display] PORT
+    serial_monitor.py [--no-display] FILE
+
+PORT is a serial port such as /dev/ttyUSB0 (needs pyserial). FILE is
+a capture of the serial data ("-" for standard input).
+"""
+
+import argparse
+import struct
+import sys
+
+SYNC = 0xA5
+FRAME_TELEMETRY = 0x01
+FRAME_DISPLAY_KEY = 0x02
+FRAME_DISPLAY_DELTA = 0x03
+
+NUM_ROWS = 7
+NUM_COLUMNS = 15
+UNCHANGED_RUN = 0x80
+
+TELEMETRY_FORMAT = "<IHHHHHbBBHH"
+TELEMETRY_FIELDS = ("timestamp", "loops", "frames", "maxLoopMicros",
+                    "activePermille", "score", "health", "asteroids",
+                    "projectiles", "droppedLogicSteps", "droppedFrames")
+
+
+def crc8_ccitt(crc, byte):
+    """Same as _crc8_ccitt_update() in avr-libc (polynomial 0x07)."""
+    crc ^= byte
+    for _ in range(8):
+        if crc & 0x80:
+            crc = ((crc << 1) ^ 0x07) & 0xFF
+        else:
+            crc = (crc << 1) & 0xFF
+    return crc
+
+
+def make_frame(frame_type, payload):
+    """Return the bytes of a frame with the given type and payload."""
+    crc = 0
+    for byte in bytes([frame_type, len(payload)]) + payload:
+        crc = crc8_ccitt(crc, byte)
+    return bytes([SYNC, frame_type, len(payload)]) + payload + bytes([crc])
+
+
+class FrameParser:
+    """Finds frames in received data, which can arrive in any size
+    pieces. Bad frames are skipped by looking for the next sync
+    byte."""
+
+    def __init__(self):
+        self.buffer = bytearray()
+
+    def feed(self, data):
+        """Add received data and return a list of (type, payload) for
+        each good frame completed."""
+        frames = []
+        buffer = self.buffer
+        buffer.extend(data)
+        while True:
+            start = buffer.find(bytes([SYNC]))
+            if start < 0:
+                buffer.clear()
+                break
+            del buffer[:start]
+            if len(buffer) < 3:
+                break
+            length = buffer[2]
+            if len(buffer) < 4 + length:
+                break
+            crc = 0
+            for byte in buffer[1:3 + length]:
+                crc = crc8_ccitt(crc, byte)
+            if crc != buffer[3 + length]:
+                # Not a real frame start - try the next sync byte
+                del buffer[:1]
+                continue
+            frames.append((buffer[1], bytes(buffer[3:3 + length])))
+            del buffer[:4 + length]
+        return frames
+
+
+def read_frames(stream):
+    """Yield (type, payload) for each good frame read from the
+    stream."""
+    parser = FrameParser()
+    while True:
+        data = stream.read(64)
+        if not data:
+            if getattr(stream, "is_open", False):
+                # Serial port read timed out - keep waiting
+                continue
+            return
+        for frame in parser.feed(data):
+            yield frame
+
+
+class DisplayMirror:
+    """The receiver's copy of the LED display."""
+
+    def __init__(self):
+        self.rows = [0] * NUM_ROWS
+        self.sequence = None    # None until the first key frame
+
+    def key_frame(self, payload):
+        if len(payload) != 1 + 2 * NUM_ROWS:
+            return False
+        self.sequence = payload[0]
+        self.rows = list(struct.unpack("<%dH" % NUM_ROWS, payload[1:]))
+        return True
+
+    def delta_frame(self, payload):
+        if self.sequence is None or not payload:
+            return False
+        if payload[0] != (self.sequence + 1) & 0xFF:
+            # Missed a frame - wait for the next key frame
+            self.sequence = None
+            return False
+        row = 0
+        i = 1
+        while i < len(payload) and row < NUM_ROWS:
+            token = payload[i]
+            if token & UNCHANGED_RUN:
+                row += token & ~UNCHANGED_RUN
+                i += 1
+            else:
+                if i + 1 >= len(payload):
+                    break
+                self.rows[row] ^= (token << 8) | payload[i + 1]
+                row += 1
+                i += 2
+        self.sequence = payload[0]
+        return True
+
+    def draw(self, status):
+        # Row 0 is at the top; bit 0 of a row is the leftmost LED
+        lines = ["\x1b[H"]
+        for value in self.rows:
+            line = "".join("\x1b[31mO\x1b[0m" if value & (1 << column)
+                           else "." for column in range(NUM_COLUMNS))
+            lines.append(" " + line + "\x1b[K")
+        lines.append("")
+        lines.append(status + "\x1b[K")
+        sys.stdout.write("\n".join(lines) + "\n")
+        sys.stdout.flush()
+
+
+def open_input(name, baud):
+    if name == "-":
+        return sys.stdin.buffer
+    if name.startswith("/dev/") or name.upper().startswith("COM"):
+        import serial
+        return serial.Serial(name, baud, timeout=0.1)
+    return open(name, "rb")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    parser.add_argument("--baud", type=int, default=38400)
+    parser.add_argument("--no-display", action="store_true",
+                        help="only print telemetry")
+    parser.add_argument("input")
+    args = parser.parse_args()
+
+    mirror = DisplayMirror()
+    status = "waiting for key frame"
+    if not args.no_display:
+        sys.stdout.write("\x1b[2J")
+
+    for frame_type, payload in read_frames(open_input(args.input, args.baud)):
+        if frame_type == FRAME_TELEMETRY:
+            if len(payload) != struct.calcsize(TELEMETRY_FORMAT):
+                continue
+            record = dict(zip(TELEMETRY_FIELDS,
+                              struct.unpack(TELEMETRY_FORMAT, payload)))
+            status = " ".join("%s=%d" % item for item in record.items())
+            if args.no_display:
+                print(status)
+                continue
+        elif args.no_display:
+            continue
+        elif frame_type == FRAME_DISPLAY_KEY:
+            mirror.key_frame(payload)
+        elif frame_type == FRAME_DISPLAY_DELTA:
+            if not mirror.delta_frame(payload):
+                status = "missed a frame - waiting for key frame"
+        else:
+            continue
+        mirror.draw(status)
+
+
+if __name__ == "__main__":
+    try:
+        main()
+    except KeyboardInterrupt:
+        pass
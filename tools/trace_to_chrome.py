@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""
+trace_to_chrome.py
+
+Turns the timeline trace recorded on the board (see src/trace.h) into
+a Chrome trace file, which can be opened in chrome://tracing or
+https://ui.perfetto.dev.
+
+Usage:
+    trace_to_chrome.py [--port PORT] [--baud N] [--header trace.h]
+                       [--input FILE] output.json
+
+With --port the trace is requested from the board (CMD_TRACE_DUMP -
+see src/command.h) and read from the serial port. Otherwise the
+FRAME_TRACE frames are read from FILE, a capture of the serial data.
+
+Event names come from the enum of event IDs in src/trace.h. Scheduled
+tasks (TRACE_TASK + task ID) are shown as "task N".
+"""
+
+import argparse
+import json
+import os
+import re
+import struct
+import sys
+import time
+
+from serial_monitor import read_frames
+
+FRAME_TRACE = 0x05
+CMD_TRACE_DUMP = 0x47
+
+EVENT_FORMAT = "<HHBB"
+EVENT_SIZE = struct.calcsize(EVENT_FORMAT)
+
+TRACE_TASK = 0x100
+TYPE_PHASES = {0: "B", 1: "E", 2: "i"}
+# The low 6 bits of the type are the event type; the top 2 are the
+# number of ticks the tick count is behind (see trace.h)
+TYPE_MASK = 0x3F
+TICKS_PENDING_SHIFT = 6
+
+MICROS_PER_COUNT = 8
+
+
+def read_event_names(header):
+    """Return a dictionary of event ID to name from the enum in
+    trace.h."""
+    names = {}
+    text = open(header).read()
+    match = re.search(r"enum\s*{([^}]*)}", text)
+    if not match:
+        return names
+    value = 0
+    for item in match.group(1).split(","):
+        item = re.sub(r"/\*.*?\*/", "", item, flags=re.S).strip()
+        if not item:
+            continue
+        if "=" in item:
+            item, number = (part.strip() for part in item.split("="))
+            value = int(number, 0)
+        names[value] = item[len("TRACE_"):].lower()
+        value += 1
+    return names
+
+
+def collect_events(frames):
+    """Return the list of (id, ticks, counts, type) events from the
+    FRAME_TRACE frames of one dump, in order."""
+    events = []
+    for frame_type, payload in frames:
+        if frame_type != FRAME_TRACE or len(payload) < 2:
+            continue
+        first, = struct.unpack("<H", payload[:2])
+        if first == 0:
+            # Start of a dump - forget any earlier (partial) one
+            events = []
+        body = payload[2:]
+        if not body:
+            if first == len(events):
+                return events
+            sys.exit("trace_to_chrome.py: frames of the trace were lost")
+        for offset in range(0, len(body) - EVENT_SIZE + 1, EVENT_SIZE):
+            events.append(struct.unpack(EVENT_FORMAT,
+                                        body[offset:offset + EVENT_SIZE]))
+    sys.exit("trace_to_chrome.py: end of trace not found")
+
+
+def to_chrome(events, names):
+    """Convert events to Chrome trace events. Times are made relative
+    to the first event; the 16 bit tick count is unwrapped assuming
+    events are less than 65 seconds apart."""
+    chrome = []
+    base = None
+    last_ticks = None
+    wraps = 0
+    for event_id, ticks, counts, event_type in events:
+        ticks = (ticks + (event_type >> TICKS_PENDING_SHIFT)) & 0xFFFF
+        if last_ticks is not None and ticks < last_ticks - 0x8000:
+            wraps += 1
+        last_ticks = ticks
+        micros = ((wraps << 16) + ticks) * 1000 + counts * MICROS_PER_COUNT
+        if base is None:
+            base = micros
+        if event_id >= TRACE_TASK:
+            name = "task %d" % (event_id - TRACE_TASK)
+        else:
+            name = names.get(event_id, "event %d" % event_id)
+        record = {"name": name, "ph": TYPE_PHASES.get(event_type & TYPE_MASK, "i"),
+                  "ts": micros - base, "pid": 0, "tid": 0}
+        if record["ph"] == "i":
+            record["s"] = "t"
+        chrome.append(record)
+    return chrome
+
+
+def request_dump(port, baud):
+    """Ask the board for its trace and return the frames received."""
+    from board_command import Board
+    board = Board(port, baud)
+    board.command(CMD_TRACE_DUMP)
+    frames = []
+    deadline = time.time() + 5.0
+    while time.time() < deadline:
+        for frame in board.parser.feed(board.serial.read(64)):
+            frames.append(frame)
+            if frame[0] == FRAME_TRACE and len(frame[1]) == 2:
+                return frames
+    return frames
+
+
+def main():
+    default_header = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                  "..", "src", "trace.h")
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    parser.add_argument("--port")
+    parser.add_argument("--baud", type=int, default=38400)
+    parser.add_argument("--header", default=default_header)
+    parser.add_argument("--input", default="-")
+    parser.add_argument("output")
+    args = parser.parse_args()
+
+    if args.port:
+        frames = request_dump(args.port, args.baud)
+    elif args.input == "-":
+        frames = read_frames(sys.stdin.buffer)
+    else:
+        frames = read_frames(open(args.input, "rb"))
+
+    events = collect_events(frames)
+    chrome = to_chrome(events, read_event_names(args.header))
+    with open(args.output, "w") as output:
+        json.dump({"traceEvents": chrome, "displayTimeUnit": "ms"}, output,
+                  indent=0)
+    print("%d events written to %s" % (len(chrome), args.output))
+
+
+if __name__ == "__main__":
+    main()